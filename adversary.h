@@ -0,0 +1,116 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * adversary.h: Search-based adversarial environment
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <vector>
+#include <random>
+#include <limits>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * adversarial environment, i.e., placer, which places the tiles to minimize the value of the slider
+ *
+ * the slider is modeled by an n-tuple network, given by 'load=<path>' and 'tuple=<tuples>' as td_slider,
+ * and is assumed to take the slide with the best reward plus afterstate value
+ * a placement is searched 'depth=<N>' placements ahead (1 by default), i.e., the value of a placement
+ * is the best slide of the slider, followed by the worst placement of the next depth, if any
+ *
+ * with 'mix=<P>', the placement is adversarial with probability P, and random otherwise,
+ * e.g., 'mix=0' is the random placer, and 'mix=1' (the default) is the greedy adversary
+ */
+class adversarial_placer : public random_placer {
+public:
+	adversarial_placer(const std::string& args = "") : random_placer(args),
+		model(network(args)), depth(1), mix(1) {
+		if (meta.find("depth") != meta.end())
+			depth = std::max(int(meta["depth"]), 1);
+		if (meta.find("mix") != meta.end())
+			mix = float(meta["mix"]);
+	}
+
+	virtual action take_action(const board& after) {
+		if (mix < 1 && std::uniform_real_distribution<float>(0, 1)(engine) >= mix)
+			return random_placer::take_action(after);
+		std::vector<int> space = spaces(after.last());
+		std::shuffle(space.begin(), space.end(), engine); // break the ties randomly
+		action worst;
+		float worst_value = std::numeric_limits<float>::infinity();
+		for (int pos : space) {
+			if (after(pos) != 0) continue;
+			for (board::cell tile = 1; tile <= 3; tile++) {
+				for (board::cell hint = 1; hint <= 3; hint++) {
+					board before = after;
+					if (before.place(pos, tile, hint) == -1) continue;
+					float value = maximize(before, depth);
+					if (value < worst_value) {
+						worst = action::place(pos, tile, hint);
+						worst_value = value;
+					}
+				}
+			}
+		}
+		return worst;
+	}
+
+protected:
+	/**
+	 * the value of the best slide of a state, or 0 if it is terminal
+	 */
+	float maximize(const board& before, int depth) const {
+		unsigned legal = before.legal();
+		float best = 0;
+		bool moved = false;
+		for (int op = 0; op < 4; op++) {
+			if (!(legal & (1u << op))) continue;
+			board after = before;
+			board::reward reward = after.slide(op);
+			float value = reward + (depth > 1 ? minimize(after, depth - 1) : model.estimate(after));
+			if (!moved || value > best) best = value, moved = true;
+		}
+		return best;
+	}
+
+	/**
+	 * the value of the worst placement of an afterstate
+	 */
+	float minimize(const board& after, int depth) const {
+		float worst = std::numeric_limits<float>::infinity();
+		for (int pos : spaces(after.last())) {
+			if (after(pos) != 0) continue;
+			for (board::cell tile = 1; tile <= 3; tile++) {
+				for (board::cell hint = 1; hint <= 3; hint++) {
+					board before = after;
+					if (before.place(pos, tile, hint) == -1) continue;
+					worst = std::min(worst, maximize(before, depth));
+				}
+			}
+		}
+		return worst != std::numeric_limits<float>::infinity() ? worst : model.estimate(after);
+	}
+
+	/**
+	 * the arguments of the model, which never learns and shares the network loaded by other agents
+	 */
+	static std::string network(const std::string& args) {
+		agent info("load= tuple= " + args);
+		std::string res = "name=model role=model share=1";
+		for (const char* key : { "load", "tuple" })
+			if (info.property(key).size()) res += std::string(" ") + key + "=" + info.property(key);
+		return res;
+	}
+
+private:
+	td_slider model;
+	int depth;
+	float mix;
+};
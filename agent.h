@@ -16,6 +16,12 @@
 #include <type_traits>
 #include <algorithm>
 #include <fstream>
+#include <cstdio>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <memory>
 #include "board.h"
 #include "action.h"
 #include "weight.h"
@@ -36,6 +42,24 @@ public:
 	virtual action take_action(const board& b) { return action(); }
 	virtual bool check_for_win(const board& b) { return false; }
 
+	/**
+	 * called after the agent's own action has been applied, so that the agent
+	 * may think in background while the opponent is taking its action
+	 */
+	virtual void ponder(const board& b) {}
+
+	/**
+	 * binary dump and restore of the internal state, e.g., RNG states and weights,
+	 * for checkpointing a run at episode boundaries
+	 */
+	virtual void dump(std::ostream& out) const {}
+	virtual void restore(std::istream& in) {}
+
+	/**
+	 * print the agent-specific statistics of the last block, e.g., search depths, then reset them
+	 */
+	virtual void report(std::ostream& out) {}
+
 public:
 	virtual std::string property(const std::string& key) const { return meta.at(key); }
 	virtual void notify(const std::string& msg) { meta[msg.substr(0, msg.find('='))] = { msg.substr(msg.find('=') + 1) }; }
@@ -64,6 +88,38 @@ public:
 	}
 	virtual ~random_agent() {}
 
+	/**
+	 * the arguments of the k-th of several independent runs, e.g., the shards of a run,
+	 * with a seed mixed from the seed of 'args' (0 by default) and k
+	 * the seeds are in [1, 2^31 - 2] and distinct for different k, since the engine
+	 * takes its seed modulo 2^31 - 1 and treats 0 as 1, e.g., seeds 0 and 1 are the same
+	 */
+	static std::string reseed(const std::string& args, uint64_t k) {
+		const uint64_t range = (1ull << 31) - 2;
+		uint64_t h = std::stoull(agent("seed=0 " + args).property("seed")) + 0x9e3779b97f4a7c15ull;
+		h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ull;
+		h = (h ^ (h >> 27)) * 0x94d049bb133111ebull;
+		h ^= h >> 31;
+		uint64_t seed = 1 + (h % range + (k % range) * 1000003 % range) % range; // 1000003 is coprime to the range
+		return args + " seed=" + std::to_string(seed);
+	}
+
+	virtual void dump(std::ostream& out) const {
+		std::stringstream ss;
+		ss << engine;
+		std::string state = ss.str();
+		uint32_t len = state.size();
+		out.write(reinterpret_cast<char*>(&len), sizeof(len));
+		out.write(state.data(), len);
+	}
+	virtual void restore(std::istream& in) {
+		uint32_t len = 0;
+		in.read(reinterpret_cast<char*>(&len), sizeof(len));
+		std::string state(len, ' ');
+		in.read(&state[0], len);
+		std::stringstream(state) >> engine;
+	}
+
 protected:
 	std::default_random_engine engine;
 };
@@ -73,26 +129,108 @@ protected:
  */
 class weight_agent : public agent {
 public:
-	weight_agent(const std::string& args = "") : agent(args), alpha(0) {
+	weight_agent(const std::string& args = "") : agent(args), alpha(0), writing(false), pending(0) {
+		if (meta.find("alpha") != meta.end())
+			alpha = float(meta["alpha"]);
 		if (meta.find("init") != meta.end())
 			init_weights(meta["init"]);
-		if (meta.find("load") != meta.end())
+		if (meta.find("load") != meta.end() && meta.find("share") != meta.end() && !alpha)
+			shared = share_weights(meta["load"]);
+		else if (meta.find("load") != meta.end())
 			load_weights(meta["load"]);
-		if (meta.find("alpha") != meta.end())
-			alpha = float(meta["alpha"]);
+		last_checkpoint = std::chrono::steady_clock::now();
 	}
 	virtual ~weight_agent() {
+		if (writer.joinable()) writer.join();
+		for (size_t i = 0; i < net.size(); i++) {
+			const weight& w = net[i];
+			if (!w.hashed()) continue;
+			std::cout << "weight[" << i << "]: " << w.size() << " -> " << w.capacity() << " slots";
+			std::cout << " (" << (weight::footprint(w.capacity(), w.tagged()) >> 20) << " MiB), ";
+			std::cout << "occupancy = " << (w.occupancy() * 100.0 / w.capacity()) << "%";
+			if (w.tagged()) std::cout << ", collisions = " << w.collision();
+			std::cout << std::endl;
+		}
 		if (meta.find("save") != meta.end())
 			save_weights(meta["save"]);
+		if (meta.find("delta") != meta.end())
+			save_delta(meta["delta"]);
+	}
+
+	virtual void close_episode(const std::string& flag = "") {
+		checkpoint();
+	}
+
+	/**
+	 * the tables in use, which are either owned or shared with other agents
+	 */
+	const std::vector<weight>& weights() const { return shared ? *shared : net; }
+	float learning_rate() const { return alpha; }
+
+	/**
+	 * load the tables read-only, shared by all the agents with 'share=1' and the same 'load=<path>'
+	 * the tables are released when the last agent sharing them is destroyed, unless
+	 * a reference is kept elsewhere, e.g., by tournament for the whole run
+	 */
+	static std::shared_ptr<const std::vector<weight>> share_weights(const std::string& path) {
+		static std::mutex mtx;
+		static std::map<std::string, std::weak_ptr<const std::vector<weight>>> cache;
+		std::lock_guard<std::mutex> lock(mtx);
+		std::shared_ptr<const std::vector<weight>> net = cache[path].lock();
+		if (net) return net;
+		std::ifstream in(path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) std::exit(-1);
+		std::shared_ptr<std::vector<weight>> tables(new std::vector<weight>);
+		uint32_t size;
+		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		tables->resize(size);
+		for (weight& w : *tables) in >> w;
+		in.close();
+		cache[path] = tables;
+		return tables;
+	}
+
+	virtual void dump(std::ostream& out) const {
+		uint32_t size = weights().size();
+		out.write(reinterpret_cast<char*>(&size), sizeof(size));
+		for (const weight& w : weights()) out << w;
+		for (const weight& w : weights()) w.save_dirty(out);
+	}
+	virtual void restore(std::istream& in) {
+		uint32_t size = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		net.resize(size);
+		for (weight& w : net) in >> w;
+		for (weight& w : net) w.load_dirty(in);
 	}
 
 protected:
+	/**
+	 * allocate the tables, e.g., "65536,65536"
+	 *
+	 * with 'budget=<MiB>', a table larger than its equal share of the budget is
+	 * hashed into the largest power-of-two number of slots that fits the share
+	 * with 'tag=1', hashed tables also detect and count collisions
+	 */
 	virtual void init_weights(const std::string& info) {
 		std::string res = info; // comma-separated sizes, e.g., "65536,65536"
 		for (char& ch : res)
 			if (!std::isdigit(ch)) ch = ' ';
 		std::stringstream in(res);
-		for (size_t size; in >> size; net.emplace_back(size));
+		std::vector<size_t> sizes;
+		for (size_t size; in >> size; sizes.push_back(size));
+		size_t budget = 0;
+		bool tagged = false;
+		if (meta.find("budget") != meta.end())
+			budget = size_t(double(meta["budget"]) * (1 << 20));
+		if (meta.find("tag") != meta.end())
+			tagged = int(meta["tag"]);
+		for (size_t size : sizes) {
+			size_t share = budget / sizes.size(), slots = 0;
+			if (budget && weight::footprint(size) > share)
+				slots = share / weight::footprint(1, tagged);
+			net.emplace_back(size, slots, tagged);
+		}
 	}
 	virtual void load_weights(const std::string& path) {
 		std::ifstream in(path, std::ios::in | std::ios::binary);
@@ -104,17 +242,253 @@ protected:
 		in.close();
 	}
 	virtual void save_weights(const std::string& path) {
+		if (!store_weights(path, weights())) std::exit(-1);
+	}
+	/**
+	 * save the pages changed since the network was initialized or loaded
+	 * see snapshot.cpp for rebuilding a network from a base file and its deltas
+	 */
+	virtual void save_delta(const std::string& path) {
 		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
 		if (!out.is_open()) std::exit(-1);
 		uint32_t size = net.size();
 		out.write(reinterpret_cast<char*>(&size), sizeof(size));
-		for (weight& w : net) out << w;
+		for (weight& w : net) w.save_delta(out), w.clean();
+		out.close();
+	}
+	static bool store_weights(const std::string& path, const std::vector<weight>& net) {
+		std::ofstream out(path, std::ios::out | std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) return false;
+		uint32_t size = net.size();
+		out.write(reinterpret_cast<char*>(&size), sizeof(size));
+		for (const weight& w : net) out << w;
 		out.close();
+		return bool(out);
+	}
+
+	/**
+	 * checkpoint the network to 'checkpoint=<path>' every 'every=<N>' episodes or 'interval=<T>' seconds
+	 *
+	 * the tables are copied into a snapshot buffer and written by a background thread,
+	 * first to <path>.tmp then renamed, so that a crash never leaves a partial checkpoint
+	 * a checkpoint that is due while the previous one is still being written is postponed
+	 */
+	void checkpoint() {
+		if (meta.find("checkpoint") == meta.end()) return;
+		auto now = std::chrono::steady_clock::now();
+		bool due = false;
+		if (meta.find("every") != meta.end())
+			due |= ++pending >= size_t(meta["every"]);
+		if (meta.find("interval") != meta.end())
+			due |= now - last_checkpoint >= std::chrono::duration<double>(double(meta["interval"]));
+		if (!due || writing) return;
+		if (writer.joinable()) writer.join();
+		snapshot = net;
+		pending = 0;
+		last_checkpoint = now;
+		writing = true;
+		std::string path = meta["checkpoint"];
+		writer = std::thread([this, path]() {
+			if (store_weights(path + ".tmp", snapshot))
+				std::rename((path + ".tmp").c_str(), path.c_str());
+			writing = false;
+		});
 	}
 
 protected:
 	std::vector<weight> net;
+	std::shared_ptr<const std::vector<weight>> shared;
 	float alpha;
+
+private:
+	std::vector<weight> snapshot;
+	std::thread writer;
+	std::atomic<bool> writing;
+	size_t pending;
+	std::chrono::steady_clock::time_point last_checkpoint;
+};
+
+/**
+ * n-tuple network player, i.e., slider
+ * select the action with the best afterstate value, and learn the values by TD(lambda)
+ *
+ * the tuples are given as hex strings of cell indices, e.g., "tuple=0123,4567"
+ * the tables are sized by the tuples, unless they are specified by 'init' or 'load'
+ *
+ * the afterstates are updated backward at the end of each episode toward their lambda-returns,
+ * with 'lambda=<L>' (0 by default, i.e., TD(0)); 'tc=1' enables temporal coherence learning,
+ * i.e., an adaptive learning rate of each weight (see weight::update)
+ */
+class td_slider : public weight_agent {
+public:
+	td_slider(const std::string& args = "") : weight_agent("name=slide role=slider " + args), lambda(0), learned(), games(0) {
+		std::string info = "0123,4567,89ab,cdef,048c,159d,26ae,37bf"; // 8x4-tuple
+		if (meta.find("tuple") != meta.end())
+			info = meta["tuple"].value;
+		std::stringstream in(info);
+		for (std::string token; std::getline(in, token, ','); ) {
+			tuples.emplace_back();
+			for (char ch : token) tuples.back().push_back(std::stoul(std::string(1, ch), nullptr, 16));
+		}
+		if (weights().empty()) {
+			std::string sizes;
+			for (auto& t : tuples) sizes += std::to_string(size_t(1) << (4 * t.size())) + ",";
+			init_weights(sizes);
+		}
+		if (weights().size() != tuples.size()) std::exit(-1);
+		if (meta.find("lambda") != meta.end())
+			lambda = float(meta["lambda"]);
+		if (meta.find("tc") != meta.end() && int(meta["tc"]) && alpha)
+			for (weight& w : net) w.coherent();
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		path.clear();
+	}
+	virtual void close_episode(const std::string& flag = "") {
+		if (alpha && path.size()) update_episode(path); // empty if the path has been learned elsewhere, e.g., by trainer
+		path.clear();
+		weight_agent::close_episode(flag);
+	}
+
+	virtual action take_action(const board& before) {
+		step best;
+		int op = select(weights(), before, best);
+		if (op == -1) return action();
+		if (alpha) path.push_back(best);
+		return action::slide(op);
+	}
+
+	virtual void dump(std::ostream& out) const {
+		weight_agent::dump(out);
+		for (const weight& w : weights()) w.save_coherence(out);
+		uint64_t total = games + learned.games; // including the block not yet reported
+		out.write(reinterpret_cast<const char*>(&total), sizeof(total));
+	}
+	virtual void restore(std::istream& in) {
+		weight_agent::restore(in);
+		for (weight& w : net) w.load_coherence(in);
+		uint64_t total = 0;
+		in.read(reinterpret_cast<char*>(&total), sizeof(total));
+		games = total;
+		learned = {};
+	}
+
+	/**
+	 * print the convergence of the last block, i.e., the mean absolute TD error per step, e.g.,
+	 * learn: learned = 9999 games, |error| = 12.34 (per step)
+	 */
+	virtual void report(std::ostream& out) {
+		if (!learned.steps) return;
+		games += learned.games;
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(2);
+		out << "\t" "learn: learned = " << games << " games, |error| = " << (learned.error / learned.steps) << " (per step)" << std::endl;
+		out.copyfmt(ff);
+		learned = {};
+	}
+
+public:
+	struct step {
+		board after;
+		board::reward reward;
+	};
+
+	/**
+	 * select the slide with the best reward plus afterstate value, evaluated by the given tables
+	 * return the opcode and store its afterstate, or -1 if there is no legal slide
+	 */
+	int select(const std::vector<weight>& w, const board& before, step& best) const {
+		float best_value = 0;
+		int best_op = -1;
+		unsigned legal = before.legal();
+		for (int op = 0; op < 4; op++) {
+			if (!(legal & (1u << op))) continue;
+			board after = before;
+			board::reward reward = after.slide(op);
+			if (reward == -1) continue;
+			float value = reward + estimate(w, after);
+			if (best_op == -1 || value > best_value) {
+				best = { after, reward };
+				best_value = value;
+				best_op = op;
+			}
+		}
+		return best_op;
+	}
+
+	/**
+	 * the feature index of a tuple, i.e., the tiles of the tuple cells in 4-bit each
+	 */
+	size_t indexof(const std::vector<unsigned>& tuple, const board& b) const {
+		size_t index = 0;
+		for (size_t i = 0; i < tuple.size(); i++)
+			index |= size_t(b(tuple[i])) << (4 * i);
+		return index;
+	}
+
+	float estimate(const board& b) const {
+		return estimate(weights(), b);
+	}
+	float estimate(const std::vector<weight>& w, const board& b) const {
+		TRACE_SCOPE("weight::estimate");
+		float value = 0;
+		for (size_t i = 0; i < tuples.size(); i++)
+			value += w[i][indexof(tuples[i], b)];
+		return value;
+	}
+
+	float update(const board& b, float u) {
+		TRACE_SCOPE("weight::update");
+		float adjust = u / tuples.size(), value = 0;
+		for (size_t i = 0; i < tuples.size(); i++)
+			value += net[i].update(indexof(tuples[i], b), adjust);
+		return value;
+	}
+
+	/**
+	 * backward TD(lambda) update of the afterstates of an episode
+	 *
+	 * the feature indices of the afterstates are extracted once into a flat buffer,
+	 * then each afterstate is updated toward G, the lambda-return from its successor,
+	 * which is then folded as G = r + (1 - lambda) * V + lambda * G with the updated V
+	 */
+	void update_episode(const std::vector<step>& path) {
+		TRACE_SCOPE("weight::update");
+		size_t n = tuples.size();
+		features.resize(path.size() * n);
+		for (size_t t = 0; t < path.size(); t++)
+			for (size_t i = 0; i < n; i++) features[t * n + i] = indexof(tuples[i], path[t].after);
+		const std::vector<weight>& w = net;
+		float target = 0;
+		for (size_t t = path.size(); t-- > 0; ) {
+			const size_t* index = &features[t * n];
+			float value = 0;
+			for (size_t i = 0; i < n; i++) value += w[i][index[i]];
+			float error = target - value, adjust = alpha * error / n;
+			value = 0;
+			for (size_t i = 0; i < n; i++) value += net[i].update(index[i], adjust);
+			target = path[t].reward + (1 - lambda) * value + lambda * target;
+			learned.error += std::fabs(error);
+		}
+		learned.steps += path.size();
+		learned.games += 1;
+	}
+
+protected:
+	std::vector<std::vector<unsigned>> tuples;
+	std::vector<step> path;
+	float lambda;
+
+private:
+	std::vector<size_t> features;
+	struct {
+		size_t games;
+		size_t steps;
+		double error;
+	} learned;
+	size_t games;
 };
 
 /**
@@ -123,16 +497,24 @@ protected:
  */
 class random_placer : public random_agent {
 public:
-	random_placer(const std::string& args = "") : random_agent("name=place role=placer " + args) {
-		spaces[0] = { 12, 13, 14, 15 };
-		spaces[1] = { 0, 4, 8, 12 };
-		spaces[2] = { 0, 1, 2, 3};
-		spaces[3] = { 3, 7, 11, 15 };
-		spaces[4] = { 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 };
+	random_placer(const std::string& args = "") : random_agent("name=place role=placer " + args) {}
+
+	/**
+	 * the positions where a tile can be placed after the last action
+	 */
+	static const std::vector<int>& spaces(unsigned last) {
+		static const std::vector<int> spaces[5] = {
+			{ 12, 13, 14, 15 },
+			{ 0, 4, 8, 12 },
+			{ 0, 1, 2, 3},
+			{ 3, 7, 11, 15 },
+			{ 0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15 },
+		};
+		return spaces[last];
 	}
 
 	virtual action take_action(const board& after) {
-		std::vector<int> space = spaces[after.last()];
+		std::vector<int> space = spaces(after.last());
 		std::shuffle(space.begin(), space.end(), engine);
 		for (int pos : space) {
 			if (after(pos) != 0) continue;
@@ -150,9 +532,6 @@ public:
 		}
 		return action();
 	}
-
-private:
-	std::vector<int> spaces[5];
 };
 
 /**
@@ -166,6 +545,15 @@ public:
 	random_slider(const std::string& args = "") : random_agent("name=slide role=slider " + args),
 		opcode({ 0, 1, 2, 3 }) {}
 
+	virtual void dump(std::ostream& out) const {
+		random_agent::dump(out);
+		out.write(reinterpret_cast<const char*>(&count_move), sizeof(count_move));
+	}
+	virtual void restore(std::istream& in) {
+		random_agent::restore(in);
+		in.read(reinterpret_cast<char*>(&count_move), sizeof(count_move));
+	}
+
 	void add_reward_by_hint (board::grid tile, board::reward reward_of_op[4], unsigned int hint_tile, int op, unsigned int count_move) {
 		int factor, secFactor = 1;
 		if (count_move > 200)
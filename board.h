@@ -13,6 +13,7 @@
 #include <iomanip>
 #include <algorithm>
 #include <cmath>
+#include "trace.h"
 
 /**
  * array-based board for Threes!
@@ -23,6 +24,9 @@
  *  (8)  (9) (10) (11)
  * (12) (13) (14) (15)
  *
+ * a 64-bit Zobrist hash of the tiles is kept along with the board, and is updated
+ * incrementally by place() and slide(); hash() combines it with the hint and the bag
+ * call rehash() after modifying the tiles directly, e.g., through operator()
  */
 class board {
 public:
@@ -34,8 +38,8 @@ public:
 	typedef int reward;
 
 public:
-	board() : tile(), attr(0) { reset(); }
-	board(const grid& b, data v = 0) : tile(b), attr(v) {}
+	board() : tile(), attr(0), key(0) { rehash(); reset(); }
+	board(const grid& b, data v = 0) : tile(b), attr(v), key(0) { rehash(); }
 	board(const board& b) = default;
 	board& operator =(const board& b) = default;
 
@@ -86,6 +90,42 @@ public:
 		hint(t);
 		return true;
 	}
+	/**
+	 * the tiles packed in 4-bit each, with cell (0) in the lowest bits
+	 */
+	data pack() const {
+		data v = 0;
+		for (int i = 0; i < 16; i++) v |= data(operator()(i)) << (4 * i);
+		return v;
+	}
+	void unpack(data v) {
+		for (int i = 0; i < 16; i++) operator()(i) = (v >> (4 * i)) & 0x0fu;
+		rehash();
+	}
+
+	/**
+	 * the Zobrist hash of the tiles, the hint, and the bag (the last action is excluded)
+	 */
+	data hash() const { return key ^ attr_key(attr); }
+	void rehash() {
+		const auto& z = zobrist();
+		key = 0;
+		for (int i = 0; i < 16; i++) key ^= z[i][operator()(i) & 0x0fu];
+	}
+
+	/**
+	 * the canonical form of the tiles under the 8 symmetries of the square,
+	 * i.e., the minimum of the packed tiles over the rotations and reflections
+	 */
+	data canonical() const { return canonical(pack()); }
+	static data canonical(data v) {
+		data t = transpose(v);
+		data form = std::min(v, reflect_horizontal(v));
+		form = std::min(form, std::min(reflect_vertical(v), reflect_horizontal(reflect_vertical(v))));
+		form = std::min(form, std::min(t, reflect_horizontal(t)));
+		form = std::min(form, std::min(reflect_vertical(t), reflect_horizontal(reflect_vertical(t))));
+		return form;
+	}
 	unsigned value() const {
 		score v = 0;
 		for (cell t : *this) v += board::itov(t);
@@ -107,12 +147,13 @@ public:
 	 * return >= 0 if the action is valid, or -1 if not
 	 */
 	reward place(unsigned pos, cell tile, cell hint_tile) {
+		TRACE_SCOPE("board::place");
 		data bak = info();
 		if (pos >= 16 || operator()(pos)) return -1;
 		if (hint() == 0 && !extract_hint_from_bag(tile)) return -1;
 		if (hint() != tile) return info(bak), -1;
 		if (!extract_hint_from_bag(hint_tile)) return info(bak), -1;
-		operator()(pos) = tile;
+		set(pos, tile);
 		last(4);
 		return itov(tile);
 	}
@@ -122,6 +163,7 @@ public:
 	 * return the reward of the action, or -1 if the action is illegal
 	 */
 	reward slide(unsigned opcode) {
+		TRACE_SCOPE("board::slide");
 		reward r = -1;
 		switch (opcode & 0b11) {
 		case 0: r = slide_up(); break;
@@ -133,47 +175,30 @@ public:
 		return r;
 	}
 
-	reward slide_left() {
-		bool moved = false;
-		reward score = 0;
-		for (int r = 0; r < 4; r++) {
-			auto& row = tile[r];
-			for (int c = 1; c < 4; c++) {
-				auto& t0 = row[c - 1];
-				auto& t1 = row[c];
-				if (t0 == 0) {
-					t0 = t1;
-					t1 = 0;
-					moved |= (t0 != 0);
-				} else if (t1 != 0 && ((t0 + t1 == 3) || (t0 == t1 && t0 >= 3 && t0 < 14))) {
-					t0 = std::max(t0, t1) + 1;
-					t1 = 0;
-					score += 3;
-					moved = true;
-				}
-			}
+	/**
+	 * the legal slides as a 4-bit mask indexed by opcode, e.g., bit 3 is set if left is legal
+	 * computed from a lookup table of rows, without mutating the board
+	 */
+	unsigned legal() const {
+		const auto& movable = row_movable();
+		unsigned mask = 0;
+		for (int i = 0; i < 4; i++) {
+			unsigned row = tile[i][0] | (tile[i][1] << 4) | (tile[i][2] << 8) | (tile[i][3] << 12);
+			unsigned col = tile[0][i] | (tile[1][i] << 4) | (tile[2][i] << 8) | (tile[3][i] << 12);
+			unsigned r = movable[row], c = movable[col];
+			mask |= ((r & 1) << 3) | ((r & 2) ? 0b0010 : 0) | (c & 1) | ((c & 2) << 1);
 		}
-		return (moved) ? score : -1;
-	}
-	reward slide_right() {
-		reflect_horizontal();
-		reward score = slide_left();
-		reflect_horizontal();
-		return score;
+		return mask;
 	}
-	reward slide_up() {
-		rotate_clockwise();
-		reward score = slide_right();
-		rotate_counterclockwise();
-		return score;
-	}
-	reward slide_down() {
-		rotate_clockwise();
-		reward score = slide_left();
-		rotate_counterclockwise();
-		return score;
+	bool is_terminal() const {
+		return legal() == 0;
 	}
 
+	reward slide_left() { return slide_lines<0, 4, 1>(); }
+	reward slide_right() { return slide_lines<3, 4, -1>(); }
+	reward slide_up() { return slide_lines<0, 1, 4>(); }
+	reward slide_down() { return slide_lines<12, 1, -4>(); }
+
 	grid getTile () {
 		return tile;
 	}
@@ -192,30 +217,27 @@ public:
 		}
 	}
 
-	void rotate_clockwise() { transpose(); reflect_horizontal(); }
-	void rotate_counterclockwise() { transpose(); reflect_vertical(); }
-	void reverse() { reflect_horizontal(); reflect_vertical(); }
+	void rotate_clockwise() { unpack(reflect_horizontal(transpose(pack()))); }
+	void rotate_counterclockwise() { unpack(reflect_vertical(transpose(pack()))); }
+	void reverse() { unpack(reflect_horizontal(reflect_vertical(pack()))); }
+	void reflect_horizontal() { unpack(reflect_horizontal(pack())); }
+	void reflect_vertical() { unpack(reflect_vertical(pack())); }
+	void transpose() { unpack(transpose(pack())); }
 
-	void reflect_horizontal() {
-		for (int r = 0; r < 4; r++) {
-			std::swap(tile[r][0], tile[r][3]);
-			std::swap(tile[r][1], tile[r][2]);
-		}
+	/**
+	 * the symmetries of the packed tiles (see pack)
+	 */
+	static data reflect_horizontal(data v) {
+		v = ((v & 0x0f0f0f0f0f0f0f0full) << 4) | ((v >> 4) & 0x0f0f0f0f0f0f0f0full);
+		return ((v & 0x00ff00ff00ff00ffull) << 8) | ((v >> 8) & 0x00ff00ff00ff00ffull);
 	}
-
-	void reflect_vertical() {
-		for (int c = 0; c < 4; c++) {
-			std::swap(tile[0][c], tile[3][c]);
-			std::swap(tile[1][c], tile[2][c]);
-		}
+	static data reflect_vertical(data v) {
+		v = ((v & 0x0000ffff0000ffffull) << 16) | ((v >> 16) & 0x0000ffff0000ffffull);
+		return (v << 32) | (v >> 32);
 	}
-
-	void transpose() {
-		for (int r = 0; r < 4; r++) {
-			for (int c = r + 1; c < 4; c++) {
-				std::swap(tile[r][c], tile[c][r]);
-			}
-		}
+	static data transpose(data v) {
+		v = (v & 0xf0f00f0ff0f00f0full) | ((v & 0x0000f0f00000f0f0ull) << 12) | ((v >> 12) & 0x0000f0f00000f0f0ull);
+		return (v & 0xff00ff0000ff00ffull) | ((v & 0x00000000ff00ff00ull) << 24) | ((v >> 24) & 0x00000000ff00ff00ull);
 	}
 
 public:
@@ -241,10 +263,124 @@ public:
 			in >> b(i);
 			b(i) = ttoi(b(i));
 		}
+		b.rehash();
 		return in;
 	}
 
+private:
+	void set(unsigned pos, cell t) {
+		const auto& z = zobrist();
+		cell& c = operator()(pos);
+		key ^= z[pos][c] ^ z[pos][t];
+		c = t;
+	}
+
+	/**
+	 * slide the four lines toward their first cells, where the cell c of line l is at
+	 * (origin + l * lane + c * step), e.g., <0, 4, 1> for left and <0, 1, 4> for up
+	 */
+	template<int origin, int lane, int step>
+	reward slide_lines() {
+		const auto& z = zobrist();
+		const auto& slid = row_slid();
+		reward score = -1;
+		for (int l = 0; l < 4; l++) {
+			cell* t[4];
+			unsigned row = 0;
+			for (int c = 0; c < 4; c++) {
+				t[c] = &operator()(origin + l * lane + c * step);
+				row |= *t[c] << (4 * c);
+			}
+			uint32_t res = slid[row];
+			if ((res & 0xffff) == row) continue;
+			for (int c = 0; c < 4; c++) {
+				cell v = (res >> (4 * c)) & 0x0fu;
+				key ^= z[origin + l * lane + c * step][*t[c]] ^ z[origin + l * lane + c * step][v];
+				*t[c] = v;
+			}
+			score = (score == -1 ? 0 : score) + (res >> 16);
+		}
+		return score;
+	}
+
+	/**
+	 * the Zobrist keys of the 16 cells, followed by the hint and the 3 bag counts
+	 * the keys of empty cells are zero, so the tiles of an empty board hash to zero
+	 */
+	static const std::array<std::array<data, 16>, 20>& zobrist() {
+		static const std::array<std::array<data, 16>, 20> keys = []() {
+			std::array<std::array<data, 16>, 20> keys;
+			data seed = 0;
+			for (auto& row : keys) {
+				for (data& k : row) {
+					data z = (seed += 0x9e3779b97f4a7c15ull);
+					z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ull;
+					z = (z ^ (z >> 27)) * 0x94d049bb133111ebull;
+					k = z ^ (z >> 31);
+				}
+			}
+			for (int i = 0; i < 16; i++) keys[i][0] = 0;
+			return keys;
+		}();
+		return keys;
+	}
+	static data attr_key(data v) {
+		const auto& z = zobrist();
+		return z[16][v & 0x0fu] ^ z[17][(v >> 8) & 0x0fu] ^ z[18][(v >> 12) & 0x0fu] ^ z[19][(v >> 16) & 0x0fu];
+	}
+
+	/**
+	 * a row (4-bit tiles, the first cell in the lowest bits) slid toward its first cell,
+	 * with the reward in the bits above
+	 */
+	static const std::array<uint32_t, 65536>& row_slid() {
+		static const std::array<uint32_t, 65536> table = []() {
+			std::array<uint32_t, 65536> table;
+			for (unsigned row = 0; row < 65536; row++) {
+				cell t[4] = { row & 0xf, (row >> 4) & 0xf, (row >> 8) & 0xf, (row >> 12) & 0xf };
+				uint32_t score = 0;
+				for (int c = 1; c < 4; c++) {
+					if (t[c] == 0) continue;
+					if (t[c - 1] == 0) {
+						t[c - 1] = t[c];
+						t[c] = 0;
+					} else if ((t[c - 1] + t[c] == 3) || (t[c - 1] == t[c] && t[c] >= 3 && t[c] < 14)) {
+						t[c - 1] = std::max(t[c - 1], t[c]) + 1;
+						t[c] = 0;
+						score += 3;
+					}
+				}
+				table[row] = t[0] | (t[1] << 4) | (t[2] << 8) | (t[3] << 12) | (score << 16);
+			}
+			return table;
+		}();
+		return table;
+	}
+
+	/**
+	 * whether a row (4-bit tiles, the first cell in the lowest bits) can slide
+	 * toward its first cell (bit 0) or toward its last cell (bit 1)
+	 */
+	static const std::array<uint8_t, 65536>& row_movable() {
+		static const std::array<uint8_t, 65536> table = []() {
+			std::array<uint8_t, 65536> table;
+			auto mergeable = [](cell a, cell b) { return (a + b == 3) || (a == b && a >= 3 && a < 14); };
+			for (unsigned row = 0; row < 65536; row++) {
+				cell t[4] = { row & 0xf, (row >> 4) & 0xf, (row >> 8) & 0xf, (row >> 12) & 0xf };
+				uint8_t bits = 0;
+				for (int c = 1; c < 4; c++) {
+					if (t[c] && (!t[c - 1] || mergeable(t[c - 1], t[c]))) bits |= 1;
+					if (t[c - 1] && (!t[c] || mergeable(t[c], t[c - 1]))) bits |= 2;
+				}
+				table[row] = bits;
+			}
+			return table;
+		}();
+		return table;
+	}
+
 private:
 	grid tile;
 	data attr; // (#3-tile:4-bit) (#2-tile:4-bit) (#1-tile:4-bit) (last_action:4-bit) (hint_tile:4-bit)
+	data key; // Zobrist hash of the tiles
 };
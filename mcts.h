@@ -0,0 +1,249 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * mcts.h: Monte Carlo tree search player
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <vector>
+#include <string>
+#include <cmath>
+#include <chrono>
+#include <algorithm>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * MCTS player, i.e., slider
+ *
+ * decision nodes branch on the four slides, chance nodes branch on the placements,
+ * which are sampled by a random placer so that the edge and bag rules are followed
+ * playouts continue with random slides for at most 'depth' slides (0 for no limit)
+ *
+ * the budget of a move is either 'playouts=<N>' playouts or 'time=<ms>' milliseconds
+ * the nodes are allocated from an arena, and the subtree under the actual slide and
+ * placement is kept for the next move
+ */
+class mcts_slider : public random_agent {
+public:
+	mcts_slider(const std::string& args = "") : random_agent("name=slide role=slider " + args),
+		env("name=env seed=" + std::to_string(engine())), root(none), last_op(-1u),
+		playouts(100), depth(0), limit(0), explore(0.5) {
+		if (meta.find("playouts") != meta.end())
+			playouts = size_t(meta["playouts"]);
+		if (meta.find("depth") != meta.end())
+			depth = size_t(meta["depth"]);
+		if (meta.find("time") != meta.end())
+			limit = double(meta["time"]);
+		if (meta.find("c") != meta.end())
+			explore = double(meta["c"]);
+	}
+
+	/**
+	 * the state of the internal placer is a part of the checkpoint, as well as the own RNG
+	 */
+	virtual void dump(std::ostream& out) const {
+		random_agent::dump(out);
+		env.dump(out);
+	}
+	virtual void restore(std::istream& in) {
+		random_agent::restore(in);
+		env.restore(in);
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		arena.clear();
+		root = none;
+		last_op = -1u;
+	}
+
+	virtual action take_action(const board& before) {
+		reuse(before);
+		if (root == none) {
+			arena.clear();
+			root = allocate(before, action(), 0);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		auto deadline = start + std::chrono::duration<double, std::milli>(limit);
+		for (size_t n = 0; limit ? (n & 15) || std::chrono::steady_clock::now() < deadline : n < playouts; n++)
+			playout();
+
+		unsigned best = none;
+		for (unsigned c = arena[root].child; c != none; c = arena[c].sibling)
+			if (best == none || arena[c].visits > arena[best].visits) best = c;
+		if (best == none) return action();
+		last_op = action::slide(arena[best].move).event();
+		return arena[best].move;
+	}
+
+protected:
+	static constexpr unsigned none = -1u;
+
+	struct node {
+		board state; // the state before the slide for a decision node, or the afterstate for a chance node
+		action move; // the slide or the placement leading to this node
+		board::reward reward; // the reward of the move
+		double total;
+		size_t visits;
+		unsigned child, sibling;
+		bool expanded;
+		float mean() const { return visits ? total / visits : 0; }
+	};
+
+	unsigned allocate(const board& state, action move, board::reward reward) {
+		arena.push_back({ state, move, reward, 0, 0, none, none, false });
+		return arena.size() - 1;
+	}
+
+	/**
+	 * select, expand, simulate, and backpropagate once
+	 */
+	void playout() {
+		path.clear();
+		path.push_back(root);
+		float value = 0;
+		while (true) {
+			unsigned curr = path.back();
+			if (!arena[curr].expanded) {
+				expand(curr);
+				if (arena[curr].visits == 0) {
+					value = simulate(arena[curr].state);
+					break;
+				}
+			}
+			if (arena[curr].child == none) break; // terminal
+			unsigned pick = select(curr);
+			path.push_back(pick);
+			unsigned next = sample(pick);
+			path.push_back(next);
+			if (arena[next].visits == 0) {
+				value = simulate(arena[next].state);
+				break;
+			}
+		}
+		for (auto it = path.rbegin(); it != path.rend(); it++) {
+			node& nd = arena[*it];
+			nd.total += value;
+			nd.visits++;
+			value += nd.reward;
+		}
+	}
+
+	void expand(unsigned curr) {
+		arena[curr].expanded = true;
+		unsigned legal = arena[curr].state.legal();
+		for (int op = 3; op >= 0; op--) {
+			if (!(legal & (1u << op))) continue;
+			board after = arena[curr].state;
+			board::reward reward = after.slide(op);
+			if (reward == -1) continue;
+			unsigned c = allocate(after, action::slide(op), reward);
+			arena[c].sibling = arena[curr].child;
+			arena[curr].child = c;
+		}
+	}
+
+	/**
+	 * UCB1 over the chance nodes, with the exploration scaled by the value of the decision node
+	 */
+	unsigned select(unsigned curr) {
+		const node& parent = arena[curr];
+		float scale = explore * (std::fabs(parent.mean()) + 1);
+		float logn = std::log(float(parent.visits + 1));
+		unsigned best = none;
+		float best_ucb = 0;
+		for (unsigned c = parent.child; c != none; c = arena[c].sibling) {
+			const node& nd = arena[c];
+			if (nd.visits == 0) return c;
+			float ucb = nd.reward + nd.mean() + scale * std::sqrt(logn / nd.visits);
+			if (best == none || ucb > best_ucb) best = c, best_ucb = ucb;
+		}
+		return best;
+	}
+
+	/**
+	 * sample a placement of a chance node, and find or create its decision node
+	 */
+	unsigned sample(unsigned chance) {
+		board state = arena[chance].state;
+		action move = env.take_action(state);
+		board::reward reward = move.apply(state);
+		for (unsigned c = arena[chance].child; c != none; c = arena[c].sibling)
+			if (arena[c].move == move) return c;
+		unsigned c = allocate(state, move, reward);
+		arena[c].sibling = arena[chance].child;
+		arena[chance].child = c;
+		return c;
+	}
+
+	/**
+	 * random playout from a decision node, return the sum of rewards
+	 */
+	float simulate(board state) {
+		float value = 0;
+		for (size_t n = 0; depth == 0 || n < depth; n++) {
+			unsigned legal = state.legal();
+			if (legal == 0) break;
+			unsigned num = (legal & 1) + ((legal >> 1) & 1) + ((legal >> 2) & 1) + (legal >> 3);
+			int op = -1;
+			for (unsigned k = std::uniform_int_distribution<unsigned>(0, num - 1)(engine); k != -1u; k--)
+				while (!(legal & (1u << ++op)));
+			value += state.slide(op);
+			value += env.take_action(state).apply(state);
+		}
+		return value;
+	}
+
+	/**
+	 * keep the subtree under the last slide and the actual placement,
+	 * by moving it into a fresh arena so that the rest of the tree is released
+	 */
+	void reuse(const board& before) {
+		unsigned next = none;
+		if (root != none && last_op != -1u) {
+			for (unsigned c = arena[root].child; c != none && next == none; c = arena[c].sibling) {
+				if (action::slide(arena[c].move).event() != last_op) continue;
+				for (unsigned d = arena[c].child; d != none; d = arena[d].sibling)
+					if (arena[d].state == before && arena[d].state.info() == before.info()) next = d;
+			}
+		}
+		root = none;
+		if (next == none) return;
+		spare.clear();
+		root = move_subtree(next);
+		arena.swap(spare);
+		arena[root].sibling = none;
+	}
+
+	unsigned move_subtree(unsigned from) {
+		unsigned id = spare.size();
+		spare.push_back(arena[from]);
+		unsigned prev = none;
+		for (unsigned c = arena[from].child; c != none; c = arena[c].sibling) {
+			unsigned k = move_subtree(c);
+			if (prev == none) spare[id].child = k;
+			else spare[prev].sibling = k;
+			prev = k;
+		}
+		if (prev != none) spare[prev].sibling = none;
+		return id;
+	}
+
+private:
+	random_placer env;
+	std::vector<node> arena;
+	std::vector<node> spare;
+	std::vector<unsigned> path;
+	unsigned root;
+	unsigned last_op;
+
+	size_t playouts;
+	size_t depth;
+	double limit;
+	double explore;
+};
@@ -0,0 +1,155 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * perf.h: Hardware performance counters via perf_event_open
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <string>
+#include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <iostream>
+#include <iomanip>
+#ifdef __linux__
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+/**
+ * a group of hardware counters of the calling thread, counting only between start() and stop()
+ *
+ * if the counters are not permitted, e.g., by perf_event_paranoid, the group is unavailable
+ * and start() and stop() do nothing; events unsupported by the CPU are reported as missing
+ */
+class perf_counter {
+public:
+	enum event { cycles, instructions, l1d_misses, llc_misses, dtlb_misses, branch_misses, num_events };
+	typedef std::array<double, num_events> sample;
+
+	perf_counter() : calls(0), leader(-1) {
+		fds.fill(-1);
+		last.fill(0);
+		last_calls = 0;
+#ifdef __linux__
+		const uint32_t types[] = {
+			PERF_TYPE_HARDWARE, PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE,
+			PERF_TYPE_HARDWARE, PERF_TYPE_HW_CACHE, PERF_TYPE_HARDWARE,
+		};
+		const uint64_t configs[] = {
+			PERF_COUNT_HW_CPU_CYCLES,
+			PERF_COUNT_HW_INSTRUCTIONS,
+			PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_CACHE_MISSES,
+			PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16),
+			PERF_COUNT_HW_BRANCH_MISSES,
+		};
+		for (int i = 0; i < num_events; i++) {
+			perf_event_attr attr;
+			std::memset(&attr, 0, sizeof(attr));
+			attr.size = sizeof(attr);
+			attr.type = types[i];
+			attr.config = configs[i];
+			attr.disabled = (leader == -1);
+			attr.exclude_kernel = 1;
+			attr.exclude_hv = 1;
+			attr.read_format = PERF_FORMAT_GROUP | PERF_FORMAT_ID | PERF_FORMAT_TOTAL_TIME_ENABLED | PERF_FORMAT_TOTAL_TIME_RUNNING;
+			int fd = syscall(__NR_perf_event_open, &attr, 0, -1, leader, 0);
+			if (fd == -1) {
+				if (i == cycles) { reason = std::strerror(errno); return; }
+				continue;
+			}
+			if (leader == -1) leader = fd;
+			fds[i] = fd;
+			ioctl(fd, PERF_EVENT_IOC_ID, &ids[i]);
+		}
+		ioctl(leader, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+#else
+		reason = "not supported on this platform";
+#endif
+	}
+	~perf_counter() {
+#ifdef __linux__
+		for (int fd : fds) if (fd != -1) close(fd);
+#endif
+	}
+	perf_counter(const perf_counter&) = delete;
+	perf_counter& operator =(const perf_counter&) = delete;
+
+	bool available() const { return leader != -1; }
+	const std::string& error() const { return reason; }
+
+	void start() {
+		calls++;
+#ifdef __linux__
+		if (leader != -1) ioctl(leader, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	}
+	void stop() {
+#ifdef __linux__
+		if (leader != -1) ioctl(leader, PERF_EVENT_IOC_DISABLE, PERF_IOC_FLAG_GROUP);
+#endif
+	}
+
+	/**
+	 * the accumulated counts, scaled if the group has been multiplexed, or -1 for missing events
+	 */
+	sample read() const {
+		sample res;
+		res.fill(-1);
+#ifdef __linux__
+		if (leader == -1) return res;
+		uint64_t buf[3 + 2 * num_events] = { 0 };
+		if (::read(leader, buf, sizeof(buf)) <= 0) return res;
+		uint64_t nr = buf[0], enabled = buf[1], running = buf[2];
+		double scale = running ? double(enabled) / running : 0;
+		for (uint64_t k = 0; k < nr && k < num_events; k++) {
+			for (int i = 0; i < num_events; i++)
+				if (fds[i] != -1 && ids[i] == buf[3 + 2 * k + 1]) res[i] = buf[3 + 2 * k] * scale;
+		}
+#endif
+		return res;
+	}
+
+	/**
+	 * print the per-move figures since the last report, e.g.,
+	 * slide: IPC = 2.31, cycles = 10421.05, L1D-miss = 12.10, LLC-miss = 0.42, dTLB-miss = 0.03, branch-miss = 8.70 (per move)
+	 */
+	void report(std::ostream& out, const std::string& role) {
+		size_t moves = calls - last_calls;
+		if (!available() || moves == 0) return;
+		sample curr = read(), diff;
+		for (int i = 0; i < num_events; i++) diff[i] = curr[i] - last[i];
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(2);
+		out << "\t" << role << ": IPC = ";
+		if (curr[cycles] >= 0 && curr[instructions] >= 0 && diff[cycles] > 0) out << (diff[instructions] / diff[cycles]);
+		else out << "n/a";
+		const char* names[] = { "cycles", "instructions", "L1D-miss", "LLC-miss", "dTLB-miss", "branch-miss" };
+		for (int i : { cycles, l1d_misses, llc_misses, dtlb_misses, branch_misses }) {
+			out << ", " << names[i] << " = ";
+			if (curr[i] >= 0) out << (diff[i] / moves);
+			else out << "n/a";
+		}
+		out << " (per move)" << std::endl;
+		out.copyfmt(ff);
+		last = curr;
+		last_calls = calls;
+	}
+
+private:
+	size_t calls;
+	int leader;
+	std::array<int, num_events> fds;
+	std::array<uint64_t, num_events> ids;
+	sample last;
+	size_t last_calls;
+	std::string reason;
+};
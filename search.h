@@ -0,0 +1,287 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * search.h: Expectimax search player with iterative deepening
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <array>
+#include <chrono>
+#include <limits>
+#include <algorithm>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * expectimax player, i.e., slider, on top of the n-tuple network of td_slider
+ *
+ * the search deepens iteratively until 'depth=<N>' slides, or until the deadline of
+ * 'time=<ms>' milliseconds, and always keeps the best move of the last completed depth
+ * the deadline is polled every 256 nodes, and the root moves are ordered by
+ * the values of the previous depth, so that a partially searched depth can still
+ * improve the move as long as the previous best move has been searched
+ *
+ * with 'ponder=1', the search continues in a background thread while the placer is
+ * taking its action, deepening all the possible placements of the last afterstate
+ * the speculation is cancelled when the next action is requested, and the search of
+ * the actual placement, if any, is resumed from its completed depth
+ */
+class search_slider : public td_slider {
+public:
+	search_slider(const std::string& args = "") : td_slider(args), limit(0), max_depth(2), pondering(false), stop(false) {
+		if (meta.find("time") != meta.end()) {
+			limit = double(meta["time"]);
+			max_depth = 64;
+		}
+		if (meta.find("depth") != meta.end())
+			max_depth = int(meta["depth"]);
+		if (meta.find("ponder") != meta.end())
+			pondering = int(meta["ponder"]);
+		searched = {};
+	}
+	virtual ~search_slider() {
+		cancel();
+	}
+
+	virtual void open_episode(const std::string& flag = "") {
+		cancel();
+		td_slider::open_episode(flag);
+	}
+	virtual void close_episode(const std::string& flag = "") {
+		cancel();
+		td_slider::close_episode(flag);
+	}
+
+	virtual action take_action(const board& before) {
+		context ctx(clock::now() + budget(), limit > 0);
+		result res = resume(before);
+		res = deepen(ctx, before, res);
+		record(ctx, res);
+		if (res.op == -1) return action();
+		if (alpha) {
+			board after = before;
+			board::reward reward = after.slide(res.op);
+			path.push_back({ after, reward });
+		}
+		return action::slide(res.op);
+	}
+
+	virtual void ponder(const board& after) {
+		if (!pondering) return;
+		cancel();
+		speculation.clear();
+		for (int pos : random_placer::spaces(after.last())) {
+			if (after(pos) != 0) continue;
+			for (board::cell t = 1; t <= 3; t++) {
+				board next = after;
+				if (after.bag(t) == 0 || next.place(pos, after.hint(), t) == -1) continue;
+				speculation.push_back({ next, result() });
+			}
+		}
+		if (speculation.empty()) return;
+		stop = false;
+		worker = std::thread(&search_slider::speculate, this);
+	}
+
+	virtual void report(std::ostream& out) {
+		td_slider::report(out);
+		if (!searched.moves) return;
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(2);
+		out << "\t" "search: depth = " << (double(searched.depth) / searched.moves) << " (max " << searched.max_depth << ")";
+		out << ", overshoot = " << (searched.overshoot / searched.moves) << " ms (max " << searched.max_overshoot << " ms)";
+		if (pondering) out << ", ponder = " << (searched.ponder * 100.0 / searched.moves) << "%";
+		out << std::endl;
+		out.copyfmt(ff);
+		searched = {};
+	}
+
+protected:
+	typedef std::chrono::steady_clock clock;
+
+	struct context {
+		clock::time_point deadline;
+		bool timed;
+		bool aborted;
+		bool cutoff; // whether any leaf was cut off by the depth
+		size_t nodes, poll;
+		const std::atomic<bool>* stop;
+		context(clock::time_point deadline, bool timed, const std::atomic<bool>* stop = nullptr)
+			: deadline(deadline), timed(timed), aborted(false), cutoff(false), nodes(0), poll(256), stop(stop) {}
+		/**
+		 * count an interior node, and poll the clock and the stop flag every 256 nodes
+		 */
+		bool expired() {
+			if ((timed || stop) && ++nodes >= poll) {
+				poll = nodes + 256;
+				if (stop && stop->load(std::memory_order_relaxed)) aborted = true;
+				if (timed && clock::now() >= deadline) aborted = true;
+			}
+			return aborted;
+		}
+		/**
+		 * count a leaf node, which never aborts the search
+		 */
+		void leaf() {
+			nodes++;
+			cutoff = true;
+		}
+	};
+
+	struct result {
+		int op;
+		int depth;
+		std::array<float, 4> values; // the values of the slides at the completed depth
+		result() : op(-1), depth(0) { values.fill(-std::numeric_limits<float>::infinity()); }
+	};
+
+	clock::duration budget() const {
+		return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::milli>(limit));
+	}
+
+	/**
+	 * deepen the search from the completed depth of 'res' until 'until' (max_depth by default)
+	 */
+	result deepen(context& ctx, const board& before, result res, int until = 0) const {
+		for (int depth = res.depth + 1; depth <= (until ?: max_depth) && !ctx.aborted; depth++) {
+			int order[] = { 0, 1, 2, 3 };
+			std::stable_sort(order, order + 4, [&](int a, int b) { return res.values[a] > res.values[b]; });
+			result next = res;
+			next.values.fill(-std::numeric_limits<float>::infinity());
+			bool searched[4] = { false };
+			ctx.cutoff = false;
+			unsigned legal = before.legal();
+			for (int op : order) {
+				if (!(legal & (1u << op))) continue;
+				board after = before;
+				board::reward reward = after.slide(op);
+				if (reward == -1) continue;
+				float value = reward + expect(ctx, after, depth - 1);
+				if (ctx.aborted) break;
+				next.values[op] = value;
+				searched[op] = true;
+			}
+			if (ctx.aborted && !(res.op != -1 && searched[res.op])) break;
+			next.op = -1;
+			for (int op = 0; op < 4; op++)
+				if (searched[op] && (next.op == -1 || next.values[op] > next.values[next.op])) next.op = op;
+			if (next.op == -1) break; // no legal slide
+			if (ctx.aborted) { res.op = next.op; break; }
+			next.depth = depth;
+			res = next;
+			if (!ctx.cutoff) break; // the search is exact, no need to go deeper
+		}
+		return res;
+	}
+
+	/**
+	 * the best value over the slides of a state, or 0 if it is terminal
+	 */
+	float maximize(context& ctx, const board& before, int depth) const {
+		if (ctx.expired()) return 0;
+		float best = 0;
+		bool moved = false;
+		unsigned legal = before.legal();
+		for (int op = 0; op < 4; op++) {
+			if (!(legal & (1u << op))) continue;
+			board after = before;
+			board::reward reward = after.slide(op);
+			if (reward == -1) continue;
+			float value = reward + expect(ctx, after, depth - 1);
+			if (!moved || value > best) best = value, moved = true;
+		}
+		return best;
+	}
+
+	/**
+	 * the expected value over the placements of an afterstate, weighted by the bag
+	 */
+	float expect(context& ctx, const board& after, int depth) const {
+		if (depth == 0 || after.hint() == 0) return ctx.leaf(), estimate(after);
+		if (ctx.expired()) return 0;
+		float sum = 0;
+		unsigned total = 0;
+		for (int pos : random_placer::spaces(after.last())) {
+			if (after(pos) != 0) continue;
+			for (board::cell t = 1; t <= 3; t++) {
+				unsigned n = after.bag(t);
+				board next = after;
+				if (n == 0 || next.place(pos, after.hint(), t) == -1) continue;
+				sum += n * maximize(ctx, next, depth);
+				total += n;
+			}
+		}
+		return total ? sum / total : estimate(after);
+	}
+
+	/**
+	 * deepen all the speculated placements depth by depth, until cancelled
+	 */
+	void speculate() {
+		for (int depth = 1; depth <= max_depth; depth++) {
+			bool exact = true;
+			for (auto& spec : speculation) {
+				if (spec.second.depth != depth - 1) continue; // terminal or exact
+				context ctx(clock::time_point(), false, &stop);
+				spec.second = deepen(ctx, spec.first, spec.second, depth);
+				if (ctx.aborted) return;
+				exact &= !ctx.cutoff;
+			}
+			if (exact) return;
+		}
+	}
+
+	/**
+	 * stop the speculation, and take the result of the actual placement, if any
+	 */
+	void cancel() {
+		if (!worker.joinable()) return;
+		stop = true;
+		worker.join();
+	}
+	result resume(const board& before) {
+		cancel();
+		result res;
+		for (auto& spec : speculation)
+			if (spec.first == before && spec.first.info() == before.info()) res = spec.second, searched.ponder += res.depth > 0;
+		speculation.clear();
+		return res;
+	}
+
+	void record(const context& ctx, const result& res) {
+		double overshoot = 0;
+		if (ctx.timed) overshoot = std::max(0.0, std::chrono::duration<double, std::milli>(clock::now() - ctx.deadline).count());
+		searched.moves++;
+		searched.depth += res.depth;
+		searched.max_depth = std::max(searched.max_depth, res.depth);
+		searched.overshoot += overshoot;
+		searched.max_overshoot = std::max(searched.max_overshoot, overshoot);
+	}
+
+protected:
+	double limit;
+	int max_depth;
+	bool pondering;
+
+	std::thread worker;
+	std::atomic<bool> stop;
+	std::vector<std::pair<board, result>> speculation;
+
+	struct {
+		size_t moves;
+		size_t ponder;
+		size_t depth;
+		int max_depth;
+		double overshoot;
+		double max_overshoot;
+	} searched;
+};
@@ -0,0 +1,133 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * serve.h: Serve the actions of a resident agent to external programs
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+#include <sstream>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+
+/**
+ * answer the move requests line by line, with an agent kept resident
+ *
+ * a request is a board in the text form of board::operator>>, i.e., the 16 tile values,
+ * optionally followed by the hint tile, e.g., "0 1 2 0 3 3 0 0 0 0 6 0 0 0 0 0 2"
+ * the response is the action in the text form of action::operator<<, e.g., "#L",
+ * or "??" if the agent has no legal action, or if the request is malformed, e.g.,
+ * a tile which is not 1, 2, or 3 * 2^k up to 6144, or a hint which is not 1, 2, or 3
+ *
+ * the requests are read in chunks, and the responses to all the complete requests
+ * of a chunk are written at once, so that pipelined requests are batched
+ */
+class server {
+public:
+	server(agent& who) : who(who) {}
+
+	/**
+	 * serve the requests from 'in' until EOF, and write the responses to 'out'
+	 */
+	void serve(int in, int out) {
+		who.open_episode();
+		std::string pending, responses;
+		char buf[65536];
+		for (ssize_t len; (len = ::read(in, buf, sizeof(buf))) > 0; ) {
+			pending.append(buf, len);
+			size_t head = 0;
+			for (size_t tail; (tail = pending.find('\n', head)) != std::string::npos; head = tail + 1)
+				responses += respond(pending.substr(head, tail - head));
+			pending.erase(0, head);
+			if (!send(out, responses)) break;
+			responses.clear();
+		}
+		who.close_episode();
+	}
+
+	/**
+	 * serve the connections to a Unix domain socket one after another
+	 * a stale socket at 'path' is replaced, but any other file is left as is
+	 * return false if the socket cannot be created, e.g., 'path' is not a socket
+	 */
+	bool listen(const std::string& path) {
+		sockaddr_un addr;
+		std::memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		if (path.size() >= sizeof(addr.sun_path)) return false;
+		std::strcpy(addr.sun_path, path.c_str());
+		struct stat st;
+		if (::lstat(path.c_str(), &st) == 0 && (!S_ISSOCK(st.st_mode) || ::unlink(path.c_str()) == -1)) return false;
+		int fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1) return false;
+		if (::bind(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) == -1 || ::listen(fd, 16) == -1) {
+			::close(fd);
+			return false;
+		}
+		for (int conn; (conn = ::accept(fd, nullptr, nullptr)) != -1; ::close(conn))
+			serve(conn, conn);
+		::close(fd);
+		return true;
+	}
+
+protected:
+	std::string respond(const std::string& request) {
+		if (request.find_first_of("0123456789") == std::string::npos) return "\n";
+		std::stringstream in(request);
+		board state;
+		for (int i = 0; i < 16; i++) {
+			unsigned tile = 0;
+			if (!(in >> tile) || !valid(tile)) return "??\n";
+			state(i) = board::ttoi(tile);
+		}
+		state.rehash();
+		unsigned hint = 0;
+		if (in >> hint) {
+			if (hint == 0 || hint > 3) return "??\n";
+			state.hint(hint);
+		}
+		if (!(in >> std::ws).eof()) return "??\n";
+		std::stringstream out;
+		out << who.take_action(state) << std::endl;
+		return out.str();
+	}
+
+	/**
+	 * whether a value is a tile of the board, i.e., 0, 1, 2, or 3 * 2^k with index up to 14
+	 */
+	static bool valid(unsigned tile) {
+		return tile < 3 || (tile <= board::itot(14) && board::itot(board::ttoi(tile)) == tile);
+	}
+
+	/**
+	 * write all the data, or return false if the peer has gone
+	 * sockets are written with MSG_NOSIGNAL, so that a closed connection is dropped without SIGPIPE
+	 */
+	static bool send(int fd, const std::string& data) {
+		bool socket = true;
+		for (size_t done = 0; done < data.size(); ) {
+			ssize_t len = -1;
+			if (socket) len = ::send(fd, data.data() + done, data.size() - done, MSG_NOSIGNAL);
+			if (len == -1 && errno == ENOTSOCK) {
+				socket = false;
+				len = ::write(fd, data.data() + done, data.size() - done);
+			}
+			if (len <= 0) return false;
+			done += len;
+		}
+		return true;
+	}
+
+private:
+	agent& who;
+};
@@ -0,0 +1,52 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * snapshot.cpp: Rebuild a network snapshot from a base file and its deltas
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include "weight.h"
+
+int main(int argc, const char* argv[]) {
+	if (argc < 3) {
+		std::cerr << "usage: " << argv[0] << " output.bin base.bin [delta ...]" << std::endl;
+		return 1;
+	}
+
+	std::vector<weight> net;
+	std::ifstream base(argv[2], std::ios::in | std::ios::binary);
+	if (!base.is_open()) {
+		std::cerr << "cannot open " << argv[2] << std::endl;
+		return 1;
+	}
+	uint32_t size = 0;
+	base.read(reinterpret_cast<char*>(&size), sizeof(size));
+	net.resize(size);
+	for (weight& w : net) base >> w;
+	base.close();
+
+	for (int i = 3; i < argc; i++) {
+		std::ifstream in(argv[i], std::ios::in | std::ios::binary);
+		in.read(reinterpret_cast<char*>(&size), sizeof(size));
+		bool ok = in.is_open() && size == net.size();
+		for (size_t k = 0; ok && k < net.size(); k++) ok = net[k].load_delta(in);
+		if (!ok) {
+			std::cerr << "mismatched delta " << argv[i] << std::endl;
+			return 1;
+		}
+		in.close();
+	}
+
+	std::ofstream out(argv[1], std::ios::out | std::ios::binary | std::ios::trunc);
+	size = net.size();
+	out.write(reinterpret_cast<char*>(&size), sizeof(size));
+	for (weight& w : net) out << w;
+	out.close();
+	return out ? 0 : 1;
+}
@@ -12,6 +12,8 @@
 #include <algorithm>
 #include <iostream>
 #include <sstream>
+#include <functional>
+#include <vector>
 #include "board.h"
 #include "action.h"
 #include "episode.h"
@@ -54,16 +56,29 @@ public:
 	 * '45.3%': 45.3% of the games terminated with 24-tiles as the largest tile
 	 */
 	void show(bool tstat = true, size_t blk = 0) const {
-		size_t num = std::min(data.size(), blk ?: block);
-		size_t stat[64] = { 0 };
-		size_t sop = 0, pop = 0, eop = 0;
-		time_t sdu = 0, pdu = 0, edu = 0;
-		board::score sum = 0, max = 0;
-		auto it = data.end();
-		for (size_t i = 0; i < num; i++) {
-			auto& ep = *(--it);
+		print(collect(blk ?: block), count, tstat, blk ? nullptr : &reporters);
+	}
+
+	void summary() const {
+		show(true, data.size());
+	}
+
+	/**
+	 * the mergeable figures of a set of episodes, e.g., the statistics shard of a process
+	 * stored as (num sum max sop pop eop sdu pdu edu:64-bit) (stat:64-bit x 64)
+	 */
+	struct tally {
+		uint64_t num, sum, max;
+		uint64_t stat[64];
+		uint64_t sop, pop, eop;
+		time_t sdu, pdu, edu;
+
+		tally() : num(0), sum(0), max(0), stat(), sop(0), pop(0), eop(0), sdu(0), pdu(0), edu(0) {}
+
+		void add(const episode& ep) {
+			num += 1;
 			sum += ep.score();
-			max = std::max(ep.score(), max);
+			max = std::max<uint64_t>(ep.score(), max);
 			stat[*std::max_element(ep.state().begin(), ep.state().end())]++;
 			sop += ep.step();
 			pop += ep.step(action::slide::type);
@@ -72,33 +87,61 @@ public:
 			pdu += ep.time(action::slide::type);
 			edu += ep.time(action::place::type);
 		}
+		void merge(const tally& t) {
+			num += t.num;
+			sum += t.sum;
+			max = std::max(max, t.max);
+			for (size_t i = 0; i < 64; i++) stat[i] += t.stat[i];
+			sop += t.sop, pop += t.pop, eop += t.eop;
+			sdu += t.sdu, pdu += t.pdu, edu += t.edu;
+		}
 
-		std::ios ff(nullptr);
-		ff.copyfmt(std::cout);
-		std::cout << std::fixed << std::setprecision(0);
-		std::cout << count << "\t";
-		std::cout << "avg = " << (sum / num) << ", ";
-		std::cout << "max = " << (max) << ", ";
-		std::cout << "ops = " << (sop * 1000.0 / sdu);
-		std::cout <<     " (" << (pop * 1000.0 / pdu);
-		std::cout <<      "|" << (eop * 1000.0 / edu) << ")";
-		std::cout << std::endl;
-		std::cout.copyfmt(ff);
-
-		if (!tstat) return;
-		for (size_t t = 0, c = 0; c < num; c += stat[t++]) {
-			if (stat[t] == 0) continue;
-			size_t accu = std::accumulate(std::begin(stat) + t, std::end(stat), size_t(0));
-			std::cout << "\t" << board::itot(t); // type
-			std::cout << "\t" << (accu * 100.0 / num) << "%"; // win rate
-			std::cout << "\t" "(" << (stat[t] * 100.0 / num) << "%" ")"; // percentage of ending
-			std::cout << std::endl;
+		void dump(std::ostream& out) const {
+			int64_t head[] = { int64_t(num), int64_t(sum), int64_t(max), int64_t(sop), int64_t(pop), int64_t(eop), sdu, pdu, edu };
+			out.write(reinterpret_cast<const char*>(head), sizeof(head));
+			out.write(reinterpret_cast<const char*>(stat), sizeof(stat));
 		}
-		std::cout << std::endl;
+		void restore(std::istream& in) {
+			int64_t head[9] = { 0 };
+			in.read(reinterpret_cast<char*>(head), sizeof(head));
+			in.read(reinterpret_cast<char*>(stat), sizeof(stat));
+			num = head[0], sum = head[1], max = head[2];
+			sop = head[3], pop = head[4], eop = head[5];
+			sdu = head[6], pdu = head[7], edu = head[8];
+		}
+	};
+
+	/**
+	 * the tally of all the episodes, including those no longer saved due to 'limit'
+	 */
+	const tally& overall() const {
+		return tallied;
 	}
 
-	void summary() const {
-		show(true, data.size());
+	/**
+	 * the tally of the last 'num' saved episodes, all of them by default
+	 */
+	tally collect(size_t num = -1) const {
+		tally t;
+		num = std::min(data.size(), num);
+		for (auto it = data.end() - num; it != data.end(); it++) t.add(*it);
+		return t;
+	}
+
+	/**
+	 * print the summary of the merged shards, in the same format as summary()
+	 */
+	static void summary(const std::vector<tally>& shards) {
+		tally t;
+		for (const tally& shard : shards) t.merge(shard);
+		print(t, t.num, true, nullptr);
+	}
+
+	/**
+	 * attach a reporter, which prints additional lines after the statistics of each block
+	 */
+	void attach(std::function<void(std::ostream&)> reporter) {
+		reporters.push_back(reporter);
 	}
 
 	bool is_finished() const {
@@ -106,13 +149,24 @@ public:
 	}
 
 	void open_episode(const std::string& flag = "") {
-		if (count++ >= limit) data.pop_front();
+		if (count++ >= limit && data.size()) data.pop_front();
 		data.emplace_back();
 		data.back().open_episode(flag);
 	}
 
 	void close_episode(const std::string& flag = "") {
 		data.back().close_episode(flag);
+		tallied.add(data.back());
+		if (count % block == 0) show();
+	}
+
+	/**
+	 * add an episode that was played elsewhere, e.g., by an actor thread
+	 */
+	void append(episode&& ep) {
+		if (count++ >= limit && data.size()) data.pop_front();
+		data.push_back(std::move(ep));
+		tallied.add(data.back());
 		if (count % block == 0) show();
 	}
 
@@ -137,16 +191,69 @@ public:
 		for (std::string line; std::getline(in, line) && line.size(); ) {
 			stat.data.emplace_back();
 			std::stringstream(line) >> stat.data.back();
+			stat.tallied.add(stat.data.back());
 		}
 		stat.total = std::max(stat.total, stat.data.size());
 		stat.count = stat.data.size();
 		return in;
 	}
 
+	/**
+	 * binary dump and restore of the episode counter and the overall tally, for checkpointing at
+	 * block boundaries; the records are not included, so that a checkpoint costs the same
+	 * regardless of the progress, and a resumed run saves only the records played after it
+	 */
+	void dump(std::ostream& out) const {
+		uint64_t count = this->count;
+		out.write(reinterpret_cast<const char*>(&count), sizeof(count));
+		tallied.dump(out);
+	}
+	void restore(std::istream& in) {
+		uint64_t count = 0;
+		in.read(reinterpret_cast<char*>(&count), sizeof(count));
+		data.clear();
+		tallied.restore(in);
+		this->count = count;
+		total = std::max(total, this->count);
+	}
+
+protected:
+	/**
+	 * print a tally as the statistics of the episodes up to 'index', see show()
+	 */
+	static void print(const tally& t, size_t index, bool tstat, const std::vector<std::function<void(std::ostream&)>>* reporters) {
+		size_t num = t.num;
+		std::ios ff(nullptr);
+		ff.copyfmt(std::cout);
+		std::cout << std::fixed << std::setprecision(0);
+		std::cout << index << "\t";
+		std::cout << "avg = " << (t.sum / num) << ", ";
+		std::cout << "max = " << (t.max) << ", ";
+		std::cout << "ops = " << (t.sop * 1000.0 / t.sdu);
+		std::cout <<     " (" << (t.pop * 1000.0 / t.pdu);
+		std::cout <<      "|" << (t.eop * 1000.0 / t.edu) << ")";
+		std::cout << std::endl;
+		std::cout.copyfmt(ff);
+		if (reporters) for (auto& reporter : *reporters) reporter(std::cout);
+
+		if (!tstat) return;
+		for (size_t i = 0, c = 0; c < num; c += t.stat[i++]) {
+			if (t.stat[i] == 0) continue;
+			size_t accu = std::accumulate(std::begin(t.stat) + i, std::end(t.stat), size_t(0));
+			std::cout << "\t" << board::itot(i); // type
+			std::cout << "\t" << (accu * 100.0 / num) << "%"; // win rate
+			std::cout << "\t" "(" << (t.stat[i] * 100.0 / num) << "%" ")"; // percentage of ending
+			std::cout << std::endl;
+		}
+		std::cout << std::endl;
+	}
+
 private:
 	size_t total;
 	size_t block;
 	size_t limit;
 	size_t count;
 	std::deque<episode> data;
+	tally tallied;
+	std::vector<std::function<void(std::ostream&)>> reporters;
 };
@@ -10,21 +10,59 @@
 #include <iostream>
 #include <fstream>
 #include <iterator>
+#include <sstream>
+#include <vector>
 #include <string>
+#include <memory>
+#include <cstdio>
 #include "board.h"
 #include "action.h"
 #include "agent.h"
+#include "mcts.h"
+#include "search.h"
+#include "adversary.h"
 #include "episode.h"
 #include "statistics.h"
+#include "trainer.h"
+#include "perf.h"
+#include "trace.h"
+#include "tournament.h"
+#include "serve.h"
 
-int main(int argc, const char* argv[]) {
-	std::cout << "Threes! Demo: ";
-	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(std::cout, " "));
-	std::cout << std::endl << std::endl;
+/**
+ * create a slider by 'type', e.g., "type=td"; the default is a random slider
+ */
+agent* make_slider(const std::string& args) {
+	std::string type = agent("type=random " + args).property("type");
+	if (type == "td") return new td_slider(args);
+	if (type == "mcts") return new mcts_slider(args);
+	if (type == "search") return new search_slider(args);
+	return new random_slider(args);
+}
+
+/**
+ * create a placer by 'type', e.g., "type=adversarial"; the default is a random placer
+ */
+agent* make_placer(const std::string& args) {
+	std::string type = agent("type=random " + args).property("type");
+	if (type == "adversarial") return new adversarial_placer(args);
+	return new random_placer(args);
+}
 
+int main(int argc, const char* argv[]) {
 	size_t total = 1000, block = 0, limit = 0;
+	size_t actors = 0, publish = 100, threads = 1;
 	std::string slide_args, place_args;
 	std::string load_path, save_path;
+	std::string checkpoint_path, resume_path;
+	std::string replay_path;
+	bool perf = false;
+	std::string trace_path;
+	std::string tournament_path;
+	std::string serve_path;
+	bool serve = false;
+	size_t shard = 0, shards = 1;
+	std::string tally_path, merge_paths;
 	for (int i = 1; i < argc; i++) {
 		std::string arg = argv[i];
 		auto match_arg = [&](std::string flag) -> bool {
@@ -49,10 +87,84 @@ int main(int argc, const char* argv[]) {
 			load_path = next_opt();
 		} else if (match_arg("save")) {
 			save_path = next_opt();
+		} else if (match_arg("checkpoint")) {
+			checkpoint_path = next_opt();
+		} else if (match_arg("resume")) {
+			resume_path = next_opt();
+		} else if (match_arg("actors")) {
+			actors = std::stoull(next_opt());
+		} else if (match_arg("publish")) {
+			publish = std::stoull(next_opt());
+		} else if (match_arg("replay")) {
+			replay_path = next_opt();
+		} else if (match_arg("threads")) {
+			threads = std::stoull(next_opt());
+		} else if (match_arg("perf")) {
+			perf = true;
+		} else if (match_arg("trace")) {
+			trace_path = next_opt();
+		} else if (match_arg("tournament")) {
+			tournament_path = next_opt();
+		} else if (match_arg("shard")) {
+			std::string opt = next_opt();
+			shard = std::stoull(opt);
+			shards = std::stoull(opt.substr(opt.find('/') + 1));
+			if (shards == 0 || shard >= shards) return -1;
+		} else if (match_arg("tally")) {
+			tally_path = next_opt();
+		} else if (match_arg("merge")) {
+			merge_paths = next_opt();
+		} else if (match_arg("serve")) {
+			serve = true;
+			if (arg.find('=') != std::string::npos) serve_path = next_opt();
 		}
 	}
 
+	std::ostream& banner = serve ? std::cerr : std::cout; // keep stdout for the responses when serving
+	banner << "Threes! Demo: ";
+	std::copy(argv, argv + argc, std::ostream_iterator<const char*>(banner, " "));
+	banner << std::endl << std::endl;
+
+	if (merge_paths.size()) {
+		std::vector<statistics::tally> tallies;
+		std::stringstream paths(merge_paths);
+		for (std::string path; std::getline(paths, path, ','); ) {
+			std::ifstream in(path, std::ios::in | std::ios::binary);
+			if (!in.is_open()) return -1;
+			tallies.emplace_back();
+			tallies.back().restore(in);
+			in.close();
+		}
+		statistics::summary(tallies);
+		return 0;
+	}
+
+	if (shards > 1) { // take an equal part of the episodes, and play them with the seeds of the shard
+		total = total / shards + (shard < total % shards);
+		for (std::string* args : { &slide_args, &place_args })
+			*args = random_agent::reseed(*args, shard);
+	}
+
+	if (serve) {
+		std::unique_ptr<agent> slider(make_slider(slide_args));
+		server srv(*slider);
+		if (serve_path.empty()) srv.serve(0, 1);
+		else if (!srv.listen(serve_path)) return -1;
+		return 0;
+	}
+
+	if (tournament_path.size()) {
+		tournament contest(make_slider, make_placer, threads);
+		std::ifstream in(tournament_path, std::ios::in);
+		contest.load(in);
+		in.close();
+		contest.run(total);
+		contest.summary(std::cout);
+		return 0;
+	}
+
 	statistics stats(total, block, limit);
+	if (trace_path.size()) trace::open(trace_path);
 
 	if (load_path.size()) {
 		std::ifstream in(load_path, std::ios::in);
@@ -61,8 +173,46 @@ int main(int argc, const char* argv[]) {
 		if (stats.is_finished()) stats.summary();
 	}
 
-	random_slider slide(slide_args);
-	random_placer place(place_args);
+	std::unique_ptr<agent> slider(make_slider(slide_args));
+	agent& slide = *slider;
+	std::unique_ptr<agent> placer(make_placer(place_args));
+	agent& place = *placer;
+	stats.attach([&](std::ostream& out) { slide.report(out); place.report(out); });
+
+	std::unique_ptr<perf_counter> counters[2];
+	if (perf) {
+		counters[0].reset(new perf_counter);
+		counters[1].reset(new perf_counter);
+		if (counters[0]->available() && counters[1]->available()) {
+			stats.attach([&](std::ostream& out) {
+				counters[0]->report(out, slide.name());
+				counters[1]->report(out, place.name());
+			});
+		} else {
+			std::cerr << "perf: counters unavailable (" << counters[0]->error() << ")" << std::endl;
+			counters[0].reset();
+			counters[1].reset();
+		}
+	}
+
+	if (resume_path.size()) {
+		std::ifstream in(resume_path, std::ios::in | std::ios::binary);
+		if (!in.is_open()) return -1;
+		stats.restore(in);
+		slide.restore(in);
+		place.restore(in);
+		in.close();
+	}
+
+	td_slider* learner = dynamic_cast<td_slider*>(&slide);
+	if (replay_path.size() && learner) {
+		std::ifstream in(replay_path, std::ios::in);
+		replayer(*learner, stats, threads).run(in);
+		in.close();
+	}
+	if (actors && learner) {
+		trainer(*learner, stats, make_placer, place_args, actors, publish).run(total);
+	}
 
 	while (!stats.is_finished()) {
 //		std::cerr << "======== Game " << stats.step() << " ========" << std::endl;
@@ -73,16 +223,34 @@ int main(int argc, const char* argv[]) {
 		episode& game = stats.back();
 		while (true) {
 			agent& who = game.take_turns(slide, place);
-			action move = who.take_action(game.state());
+			if (&who == &slide && game.state().is_terminal()) break; // the slider has no legal slide
+			perf_counter* counter = counters[&who == &slide ? 0 : 1].get();
+			if (counter) counter->start();
+			action move;
+			{
+				TRACE_SCOPE("agent::take_action");
+				move = who.take_action(game.state());
+			}
+			if (counter) counter->stop();
 //			std::cerr << game.state() << "#" << game.step() << " " << who.name() << ": " << move << std::endl;
 			if (game.apply_action(move) != true) break;
 			if (who.check_for_win(game.state())) break;
+			who.ponder(game.state());
 		}
 		agent& win = game.last_turns(slide, place);
-		stats.close_episode(win.name());
-
 		slide.close_episode(win.name());
 		place.close_episode(win.name());
+		stats.close_episode(win.name()); // after the agents, so that the block reports include the last episode
+		trace::poll();
+
+		if (checkpoint_path.size() && stats.step() % (block ? block : total) == 0) {
+			std::ofstream out(checkpoint_path + ".tmp", std::ios::out | std::ios::binary | std::ios::trunc);
+			stats.dump(out);
+			slide.dump(out);
+			place.dump(out);
+			out.close();
+			if (out) std::rename((checkpoint_path + ".tmp").c_str(), checkpoint_path.c_str());
+		}
 	}
 
 	if (save_path.size()) {
@@ -91,5 +259,13 @@ int main(int argc, const char* argv[]) {
 		out.close();
 	}
 
+	if (tally_path.size()) {
+		std::ofstream out(tally_path, std::ios::out | std::ios::binary | std::ios::trunc);
+		stats.overall().dump(out);
+		out.close();
+	}
+
+	if (trace_path.size()) trace::close();
+
 	return 0;
 }
@@ -0,0 +1,161 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * tournament.h: Round-robin comparison of agent configurations
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <thread>
+#include <atomic>
+#include <functional>
+#include <algorithm>
+#include <cmath>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+
+/**
+ * play every slider configuration against every placer configuration
+ *
+ * the configurations are listed one per line, as "slide <args>" or "place <args>", e.g.,
+ * slide type=td load=weights.bin
+ * slide type=search load=weights.bin depth=2
+ * place
+ *
+ * the games of each pairing are split into chunks, which are played concurrently
+ * by a pool of threads; chunk k of every pairing uses the same placer seed,
+ * and the seeds of different chunks are distinct, see random_agent::reseed
+ * networks are loaded with 'share=1', and are held for the whole run, so that each
+ * weight file is loaded once
+ */
+class tournament {
+public:
+	typedef std::function<agent*(const std::string&)> factory;
+
+	tournament(factory make_slider, factory make_placer, size_t threads = 1)
+		: make_slider(make_slider), make_placer(make_placer), threads(threads ? threads : 1) {}
+
+	void load(std::istream& in) {
+		for (std::string line; std::getline(in, line); ) {
+			std::stringstream ss(line);
+			std::string role, args;
+			ss >> role;
+			std::getline(ss >> std::ws, args);
+			if (role == "slide" || role == "play") sliders.push_back(args);
+			if (role == "place" || role == "env") placers.push_back(args);
+		}
+		if (sliders.empty()) sliders.push_back("");
+		if (placers.empty()) placers.push_back("");
+	}
+
+	void run(size_t games) {
+		size_t chunk = std::max<size_t>(1, (games + threads - 1) / threads);
+		for (size_t s = 0; s < sliders.size(); s++) {
+			for (size_t p = 0; p < placers.size(); p++) {
+				results.push_back({ s, p, {} });
+				for (size_t k = 0; k * chunk < games; k++)
+					jobs.push_back({ results.size() - 1, k, std::min(chunk, games - k * chunk), {} });
+			}
+		}
+		std::vector<std::shared_ptr<const std::vector<weight>>> held;
+		for (const std::vector<std::string>* configs : { &sliders, &placers }) {
+			for (const std::string& args : *configs) {
+				agent info("load= alpha=0 " + args);
+				if (info.property("load").size() && std::stof(info.property("alpha")) == 0)
+					held.push_back(weight_agent::share_weights(info.property("load")));
+			}
+		}
+		std::atomic<size_t> next(0);
+		std::vector<std::thread> pool;
+		for (size_t i = 0; i < threads; i++)
+			pool.emplace_back([&]() { for (size_t j; (j = next++) < jobs.size(); ) play(jobs[j]); });
+		for (std::thread& th : pool) th.join();
+		for (job& jb : jobs) {
+			auto& scores = results[jb.pairing].scores;
+			scores.insert(scores.end(), jb.scores.begin(), jb.scores.end());
+		}
+	}
+
+	/**
+	 * print the comparison table, with the 95% confidence interval of the average score
+	 */
+	void summary(std::ostream& out) const {
+		std::ios ff(nullptr);
+		ff.copyfmt(out);
+		out << std::fixed << std::setprecision(1);
+		out << "slide" "\t" "place" "\t" "games" "\t" "avg" "\t" "95% CI" "\t" "stdev" "\t" "max" << std::endl;
+		for (const result& res : results) {
+			size_t n = res.scores.size();
+			double sum = 0, sq = 0, max = 0;
+			for (double v : res.scores) sum += v, sq += v * v, max = std::max(max, v);
+			double avg = n ? sum / n : 0;
+			double sd = n > 1 ? std::sqrt(std::max(0.0, (sq - n * avg * avg) / (n - 1))) : 0;
+			double ci = n ? 1.96 * sd / std::sqrt(double(n)) : 0;
+			out << "[" << (sliders[res.slider].size() ? sliders[res.slider] : "default") << "]" "\t";
+			out << "[" << (placers[res.placer].size() ? placers[res.placer] : "default") << "]" "\t";
+			out << n << "\t" << avg << "\t" "+-" << ci << "\t" << sd << "\t" << max << std::endl;
+		}
+		out.copyfmt(ff);
+	}
+
+protected:
+	struct result {
+		size_t slider, placer;
+		std::vector<double> scores;
+	};
+	struct job {
+		size_t pairing;
+		size_t chunk;
+		size_t games;
+		std::vector<double> scores;
+	};
+
+	static std::string seeded(const std::string& args, size_t chunk) {
+		return random_agent::reseed(args + " share=1", chunk);
+	}
+
+	void play(job& jb) {
+		const result& res = results[jb.pairing];
+		std::unique_ptr<agent> slide(make_slider(seeded(sliders[res.slider], jb.chunk)));
+		std::unique_ptr<agent> place(make_placer(seeded(placers[res.placer], jb.chunk)));
+		for (size_t i = 0; i < jb.games; i++) {
+			slide->open_episode("~:" + place->name());
+			place->open_episode(slide->name() + ":~");
+			episode game;
+			game.open_episode(slide->name() + ":" + place->name());
+			while (true) {
+				agent& who = game.take_turns(*slide, *place);
+				if (&who == slide.get() && game.state().is_terminal()) break; // the slider has no legal slide
+				action move = who.take_action(game.state());
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+				who.ponder(game.state());
+			}
+			agent& win = game.last_turns(*slide, *place);
+			game.close_episode(win.name());
+			slide->close_episode(win.name());
+			place->close_episode(win.name());
+			jb.scores.push_back(game.score());
+		}
+	}
+
+private:
+	factory make_slider;
+	factory make_placer;
+	size_t threads;
+	std::vector<std::string> sliders;
+	std::vector<std::string> placers;
+	std::vector<result> results;
+	std::vector<job> jobs;
+};
@@ -0,0 +1,173 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * trace.h: Compile-time switchable tracing of the hot paths
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <string>
+
+/**
+ * TRACE_SCOPE("name") records the duration of the enclosing scope
+ *
+ * the events are kept in per-thread ring buffers, which keep the latest
+ * THREES_TRACE_EVENTS events of each thread, and are dumped in the Chrome
+ * trace event format (chrome://tracing, or https://ui.perfetto.dev/)
+ * at the end of a run, or at the next poll() after receiving SIGUSR1
+ *
+ * tracing is compiled in only if THREES_TRACE is defined (see makefile),
+ * otherwise TRACE_SCOPE expands to nothing and the functions are empty
+ */
+#ifdef THREES_TRACE
+
+#include <array>
+#include <vector>
+#include <atomic>
+#include <mutex>
+#include <chrono>
+#include <fstream>
+#include <iomanip>
+#include <csignal>
+#include <cstdint>
+
+#ifndef THREES_TRACE_EVENTS
+#define THREES_TRACE_EVENTS (1 << 18)
+#endif
+
+#define TRACE_CONCAT_(a, b) a##b
+#define TRACE_CONCAT(a, b) TRACE_CONCAT_(a, b)
+#define TRACE_SCOPE(name) trace::scope TRACE_CONCAT(trace_scope_, __LINE__)(name)
+
+namespace trace {
+
+struct event {
+	const char* name;
+	uint64_t begin;
+	uint64_t end;
+};
+
+/**
+ * a ring buffer written only by its owner thread
+ */
+struct buffer {
+	std::array<event, THREES_TRACE_EVENTS> events;
+	std::atomic<size_t> head;
+	unsigned tid;
+	buffer(unsigned tid) : head(0), tid(tid) {}
+	void push(const event& ev) {
+		size_t h = head.load(std::memory_order_relaxed);
+		events[h % events.size()] = ev;
+		head.store(h + 1, std::memory_order_release);
+	}
+};
+
+struct registry {
+	std::mutex mtx;
+	std::vector<buffer*> buffers; // never released, so that exited threads can be dumped
+	std::vector<buffer*> idle; // the buffers of exited threads, reused by new threads
+	std::string path;
+	static registry& instance() { static registry r; return r; }
+};
+
+inline volatile std::sig_atomic_t& requested() { static volatile std::sig_atomic_t flag = 0; return flag; }
+
+inline uint64_t now() {
+	auto t = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(t).count();
+}
+
+/**
+ * the buffer of the calling thread, which is returned to the registry when the thread exits,
+ * so that short-lived threads, e.g., the pondering workers, reuse a bounded number of buffers
+ * the events of a reused buffer keep its tid, as the threads sharing it never overlap in time
+ */
+inline buffer& local() {
+	struct owner {
+		buffer* buf = nullptr;
+		~owner() {
+			if (!buf) return;
+			registry& reg = registry::instance();
+			std::lock_guard<std::mutex> lock(reg.mtx);
+			reg.idle.push_back(buf);
+		}
+	};
+	static thread_local owner own;
+	if (own.buf) return *own.buf;
+	registry& reg = registry::instance();
+	std::lock_guard<std::mutex> lock(reg.mtx);
+	if (reg.idle.size()) {
+		own.buf = reg.idle.back();
+		reg.idle.pop_back();
+	} else {
+		own.buf = new buffer(reg.buffers.size());
+		reg.buffers.push_back(own.buf);
+	}
+	return *own.buf;
+}
+
+class scope {
+public:
+	scope(const char* name) : name(name), begin(now()) {}
+	~scope() { local().push({ name, begin, now() }); }
+private:
+	const char* name;
+	uint64_t begin;
+};
+
+/**
+ * write all the buffers to the trace file
+ */
+inline void dump() {
+	registry& reg = registry::instance();
+	if (reg.path.empty()) return;
+	std::lock_guard<std::mutex> lock(reg.mtx);
+	std::ofstream out(reg.path, std::ios::out | std::ios::trunc);
+	out << std::fixed << std::setprecision(3);
+	out << "{\"traceEvents\":[";
+	bool first = true;
+	for (buffer* buf : reg.buffers) {
+		size_t head = buf->head.load(std::memory_order_acquire);
+		size_t tail = head > buf->events.size() ? head - buf->events.size() : 0;
+		for (size_t i = tail; i < head; i++) {
+			const event& ev = buf->events[i % buf->events.size()];
+			out << (first ? "" : ",") << std::endl;
+			out << "{\"name\":\"" << ev.name << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << buf->tid;
+			out << ",\"ts\":" << (ev.begin / 1000.0) << ",\"dur\":" << ((ev.end - ev.begin) / 1000.0) << "}";
+			first = false;
+		}
+	}
+	out << std::endl << "]}" << std::endl;
+}
+
+/**
+ * set the trace file, and dump to it at the next poll() after SIGUSR1
+ */
+inline void open(const std::string& path) {
+	registry::instance().path = path;
+	std::signal(SIGUSR1, [](int) { requested() = 1; });
+}
+inline void poll() {
+	if (!requested()) return;
+	requested() = 0;
+	dump();
+}
+inline void close() {
+	dump();
+}
+
+} // namespace trace
+
+#else
+
+#define TRACE_SCOPE(name)
+
+namespace trace {
+inline void open(const std::string& path) {}
+inline void poll() {}
+inline void close() {}
+} // namespace trace
+
+#endif
@@ -0,0 +1,288 @@
+/**
+ * Framework for Threes! and its variants (C++ 11)
+ * trainer.h: Actor/learner training for n-tuple networks
+ *
+ * Author: Theory of Computer Games
+ *         Computer Games and Intelligence (CGI) Lab, NYCU, Taiwan
+ *         https://cgilab.nctu.edu.tw/
+ */
+
+#pragma once
+#include <atomic>
+#include <thread>
+#include <mutex>
+#include <memory>
+#include <functional>
+#include <vector>
+#include <string>
+#include "board.h"
+#include "action.h"
+#include "agent.h"
+#include "episode.h"
+#include "statistics.h"
+
+/**
+ * lock-free single-producer single-consumer ring buffer
+ */
+template<typename type, size_t capacity = (1 << 16)>
+class ring {
+	static_assert((capacity & (capacity - 1)) == 0, "capacity must be a power of two");
+public:
+	ring() : head(0), tail(0) {}
+
+	bool push(const type& item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == capacity) return false;
+		buffer[t & (capacity - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+	bool pop(type& item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = buffer[h & (capacity - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+	bool empty() const {
+		return head.load(std::memory_order_acquire) == tail.load(std::memory_order_acquire);
+	}
+
+private:
+	alignas(64) std::atomic<size_t> head;
+	alignas(64) std::atomic<size_t> tail;
+	alignas(64) type buffer[capacity];
+};
+
+/**
+ * actor/learner training of a TD slider
+ *
+ * the actors play games with a read-only snapshot of the network, and stream the
+ * trajectories, i.e., packed afterstates and rewards, into their own ring buffers
+ * the learner, i.e., the calling thread, applies the TD updates episode by episode,
+ * and publishes a new snapshot to the actors every 'publish' episodes
+ * the finished episodes are also handed to the learner, which is the only thread
+ * that touches the statistics, and thereby the reporters of the agents
+ * each actor plays against its own placer, made by 'make_placer' from 'place_args'
+ */
+class trainer {
+public:
+	typedef std::function<agent*(const std::string&)> factory;
+
+	trainer(td_slider& learner, statistics& stats, factory make_placer, const std::string& place_args, size_t actors, size_t publish = 100)
+		: learner(learner), stats(stats), make_placer(make_placer), place_args(place_args),
+		  rings(actors), games(actors), actors(actors), publish(publish ? publish : 1),
+		  issued(stats.step()), finished(0), version(0) {}
+
+	void run(size_t total) {
+		shared.reset(new std::vector<weight>(learner.weights()));
+		std::vector<std::thread> threads;
+		for (size_t i = 0; i < actors; i++)
+			threads.emplace_back(&trainer::play, this, i, total);
+
+		std::vector<std::vector<td_slider::step>> paths(actors);
+		for (size_t learned = 0; finished < actors || !drained(); ) {
+			bool idle = true;
+			for (size_t i = 0; i < actors; i++) {
+				for (record rec; rings[i].pop(rec); idle = false) {
+					if (rec.reward != -1) {
+						paths[i].push_back({ {}, rec.reward });
+						paths[i].back().after.unpack(rec.after);
+						continue;
+					}
+					if (learner.learning_rate()) learner.update_episode(paths[i]);
+					learner.close_episode();
+					paths[i].clear();
+					episode* game = nullptr;
+					games[i].pop(game); // pushed before the end of the trajectory
+					stats.append(std::move(*game));
+					delete game;
+					if (++learned % publish == 0) {
+						std::shared_ptr<const std::vector<weight>> next(new std::vector<weight>(learner.weights()));
+						std::lock_guard<std::mutex> lock(mtx);
+						shared = next;
+						version++;
+					}
+				}
+			}
+			if (idle) std::this_thread::yield();
+		}
+		for (std::thread& th : threads) th.join();
+	}
+
+protected:
+	/**
+	 * a step of a trajectory, or the end of an episode if reward is -1
+	 */
+	struct record {
+		board::data after;
+		board::reward reward;
+	};
+
+	void play(size_t id, size_t total) {
+		std::unique_ptr<agent> placer(make_placer(random_agent::reseed(place_args, 1 + id)));
+		agent& place = *placer;
+		actor slide(learner);
+		std::shared_ptr<const std::vector<weight>> snapshot;
+		size_t seen = -1;
+
+		while (issued++ < total) {
+			if (version != seen) {
+				std::lock_guard<std::mutex> lock(mtx);
+				snapshot = shared;
+				seen = version;
+			}
+			slide.open_episode(snapshot.get());
+			place.open_episode(slide.name() + ":~");
+			episode game;
+			game.open_episode(slide.name() + ":" + place.name());
+			while (true) {
+				agent& who = game.take_turns(slide, place);
+				if (&who == &slide && game.state().is_terminal()) break; // the slider has no legal slide
+				action move = who.take_action(game.state());
+				if (game.apply_action(move) != true) break;
+				if (who.check_for_win(game.state())) break;
+			}
+			agent& win = game.last_turns(slide, place);
+			game.close_episode(win.name());
+			place.close_episode(win.name());
+
+			episode* done = new episode(std::move(game));
+			while (!games[id].push(done)) std::this_thread::yield();
+			for (const td_slider::step& st : slide.trajectory())
+				push(id, { st.after.pack(), st.reward });
+			push(id, { 0, -1 });
+		}
+		finished++;
+	}
+
+	void push(size_t id, const record& rec) {
+		while (!rings[id].push(rec)) std::this_thread::yield();
+	}
+
+	bool drained() const {
+		for (auto& r : rings) if (!r.empty()) return false;
+		return true;
+	}
+
+	/**
+	 * the slider of an actor, which plays greedily with a snapshot of the learner's network
+	 */
+	class actor : public agent {
+	public:
+		actor(const td_slider& learner)
+			: agent("name=" + learner.name() + " role=slider"), learner(learner), net(nullptr) {}
+		void open_episode(const std::vector<weight>* snapshot) {
+			net = snapshot;
+			path.clear();
+		}
+		virtual action take_action(const board& before) {
+			td_slider::step best;
+			int op = learner.select(*net, before, best);
+			if (op == -1) return action();
+			path.push_back(best);
+			return action::slide(op);
+		}
+		const std::vector<td_slider::step>& trajectory() const { return path; }
+	private:
+		const td_slider& learner;
+		const std::vector<weight>* net;
+		std::vector<td_slider::step> path;
+	};
+
+private:
+	td_slider& learner;
+	statistics& stats;
+	factory make_placer;
+	std::string place_args;
+	std::vector<ring<record>> rings;
+	std::vector<ring<episode*, 1024>> games;
+	size_t actors;
+	size_t publish;
+
+	std::atomic<size_t> issued;
+	std::atomic<size_t> finished;
+	std::atomic<size_t> version;
+	std::mutex mtx;
+	std::shared_ptr<const std::vector<weight>> shared;
+};
+
+/**
+ * offline training of a TD slider from saved episode logs, e.g., --save=stats.txt
+ *
+ * the logs are read in batches of 'batch' episodes; parsing and replaying a batch is
+ * sharded across 'threads' threads, overlapped with the updates of the previous batch,
+ * which are applied in log order by the calling thread, until the statistics are finished,
+ * i.e., replayed episodes count toward '--total'
+ */
+class replayer {
+public:
+	replayer(td_slider& learner, statistics& stats, size_t threads = 1, size_t batch = 1024)
+		: learner(learner), stats(stats), threads(threads ? threads : 1), batch(batch) {}
+
+	void run(std::istream& in) {
+		shard curr, next;
+		read(in, curr);
+		replay(curr);
+		while (curr.lines.size() && !stats.is_finished()) {
+			read(in, next);
+			std::vector<std::thread> workers;
+			for (size_t k = 0; k < threads; k++)
+				workers.emplace_back(&replayer::replay_shard, this, std::ref(next), k);
+			learn(curr);
+			for (std::thread& th : workers) th.join();
+			std::swap(curr, next);
+		}
+	}
+
+protected:
+	struct shard {
+		std::vector<std::string> lines;
+		std::vector<episode> games;
+		std::vector<std::vector<td_slider::step>> paths;
+	};
+
+	void read(std::istream& in, shard& sh) {
+		sh.lines.clear();
+		for (std::string line; sh.lines.size() < batch && std::getline(in, line); )
+			if (line.size()) sh.lines.push_back(line);
+		sh.games.clear();
+		sh.games.resize(sh.lines.size());
+		sh.paths.resize(sh.lines.size());
+	}
+
+	void replay(shard& sh) {
+		for (size_t k = 0; k < threads; k++) replay_shard(sh, k);
+	}
+
+	/**
+	 * parse every 'threads'-th episode starting from 'k', and collect the afterstates of its slides
+	 */
+	void replay_shard(shard& sh, size_t k) {
+		for (size_t i = k; i < sh.lines.size(); i += threads) {
+			std::stringstream(sh.lines[i]) >> sh.games[i];
+			std::vector<td_slider::step>& path = sh.paths[i];
+			path.clear();
+			board state;
+			for (const action& move : sh.games[i].actions()) {
+				board::reward reward = move.apply(state);
+				if (move.type() == action::slide::type && reward != -1)
+					path.push_back({ state, reward });
+			}
+		}
+	}
+
+	void learn(shard& sh) {
+		for (size_t i = 0; i < sh.lines.size() && !stats.is_finished(); i++) {
+			if (learner.learning_rate()) learner.update_episode(sh.paths[i]);
+			learner.close_episode();
+			stats.append(std::move(sh.games[i]));
+		}
+	}
+
+private:
+	td_slider& learner;
+	statistics& stats;
+	size_t threads;
+	size_t batch;
+};
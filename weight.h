@@ -11,39 +11,273 @@
 #include <iostream>
 #include <vector>
 #include <utility>
+#include <cstdint>
+#include <algorithm>
+#include <cmath>
 
+/**
+ * lookup table of an n-tuple feature
+ *
+ * a table is either dense, i.e., one entry per feature index,
+ * or hashed, i.e., 'len' feature indices share 2^k slots
+ * a hashed table may also keep a 16-bit tag per slot to detect collisions,
+ * in which case a colliding write claims the slot and resets its value
+ *
+ * writes are tracked by a dirty bit per page of slots, so that only the pages
+ * changed since the last clean() are stored by save_delta()
+ *
+ * with temporal coherence enabled, update() scales each step by a learning rate
+ * of its own slot, i.e., |E| / A, where E and A are the sums of the past steps
+ * and of their absolute values (Beal and Smith, 1999)
+ */
 class weight {
 public:
 	typedef float type;
+	typedef uint16_t tag;
 
 public:
-	weight() {}
-	weight(size_t len) : value(len) {}
-	weight(weight&& f) : value(std::move(f.value)) {}
+	weight() : length(0), bits(0), collisions(0) {}
+	weight(size_t len) : value(len), dirty(pages(len)), length(len), bits(0), collisions(0) {}
+	weight(size_t len, size_t slots, bool tagged = false) : length(len), bits(0), collisions(0) {
+		while ((size_t(2) << bits) <= slots) bits++;
+		if (slots == 0 || (size_t(1) << bits) >= len) bits = 0;
+		value.assign(bits ? size_t(1) << bits : len, 0);
+		if (bits && tagged) tags.assign(value.size(), 0);
+		dirty.assign(pages(value.size()), 0);
+	}
+	weight(weight&& f) = default;
 	weight(const weight& f) = default;
 
 	weight& operator =(const weight& f) = default;
-	type& operator[] (size_t i) { return value[i]; }
-	const type& operator[] (size_t i) const { return value[i]; }
-	size_t size() const { return value.size(); }
+	weight& operator =(weight&& f) = default;
+	type& operator[] (size_t i) {
+		if (!bits) return touch(i), value[i];
+		uint64_t h = mix(i);
+		size_t slot = h >> (64 - bits);
+		touch(slot);
+		if (tags.size() && tags[slot] != checksum(h)) {
+			if (tags[slot]) collisions++;
+			tags[slot] = checksum(h);
+			value[slot] = 0;
+			if (coherence.size()) coherence[2 * slot] = coherence[2 * slot + 1] = 0;
+		}
+		return value[slot];
+	}
+	const type& operator[] (size_t i) const {
+		if (!bits) return value[i];
+		static const type none = 0;
+		uint64_t h = mix(i);
+		size_t slot = h >> (64 - bits);
+		if (tags.size() && tags[slot] != checksum(h)) return none;
+		return value[slot];
+	}
+
+	/**
+	 * add a step to an entry, scaled by the coherence of its slot if enabled
+	 * return the updated value
+	 */
+	type update(size_t i, type step) {
+		type& v = operator[](i);
+		if (coherence.size()) {
+			type* tc = &coherence[2 * (&v - value.data())];
+			type rate = tc[1] != 0 ? std::abs(tc[0]) / tc[1] : 1;
+			tc[0] += step;
+			tc[1] += std::abs(step);
+			step *= rate;
+		}
+		return v += step;
+	}
+
+	/**
+	 * enable (or disable) the temporal coherence of the slots
+	 */
+	void coherent(bool enable = true) {
+		if (enable) coherence.assign(2 * value.size(), 0);
+		else coherence.clear();
+	}
+	bool coherent() const { return coherence.size() != 0; }
+
+	/**
+	 * the number of feature indices, i.e., the size of the equivalent dense table
+	 */
+	size_t size() const { return length; }
+	/**
+	 * the number of allocated slots
+	 */
+	size_t capacity() const { return value.size(); }
+	bool hashed() const { return bits != 0; }
+	bool tagged() const { return tags.size() != 0; }
+	/**
+	 * the number of slots in use, i.e., tagged slots or non-zero entries
+	 */
+	size_t occupancy() const {
+		size_t n = 0;
+		if (tags.size()) for (tag t : tags) n += (t != 0);
+		else for (type v : value) n += (v != 0);
+		return n;
+	}
+	/**
+	 * the number of slots taken over by another feature index (tagged tables only)
+	 */
+	size_t collision() const { return collisions; }
+	/**
+	 * the memory footprint of a table with the given number of slots
+	 */
+	static size_t footprint(size_t slots, bool tagged = false) {
+		return slots * (sizeof(type) + (tagged ? sizeof(tag) : 0));
+	}
+
+	/**
+	 * the number of pages written since the last clean()
+	 */
+	size_t dirty_pages() const {
+		size_t n = 0;
+		for (uint64_t word : dirty) n += __builtin_popcountll(word);
+		return n;
+	}
+	void clean() {
+		std::fill(dirty.begin(), dirty.end(), 0);
+	}
+
+protected:
+	static constexpr size_t page_bits = 10; // 1024 slots per page
+
+	static size_t pages(size_t slots) { return (((slots + (1 << page_bits) - 1) >> page_bits) + 63) / 64; }
+	void touch(size_t slot) { dirty[slot >> (page_bits + 6)] |= 1ull << ((slot >> page_bits) & 63); }
+
+	static uint64_t mix(uint64_t x) {
+		x ^= x >> 30; x *= 0xbf58476d1ce4e5b9ull;
+		x ^= x >> 27; x *= 0x94d049bb133111ebull;
+		return x ^ (x >> 31);
+	}
+	static tag checksum(uint64_t h) { return tag(h) | 1; }
 
 public:
+	/**
+	 * dense tables are stored as (size:64-bit) (value:32-bit x size)
+	 * hashed tables set the highest bit of size, then store
+	 * (size:64-bit) (slots:64-bit) (tagged:8-bit) (value:32-bit x slots) [(tag:16-bit x slots)]
+	 */
 	friend std::ostream& operator <<(std::ostream& out, const weight& w) {
 		auto& value = w.value;
-		uint64_t size = value.size();
+		uint64_t size = w.length;
+		if (w.bits) size |= hashed_flag;
 		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
-		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * size);
+		if (w.bits) {
+			uint64_t slots = value.size();
+			uint8_t tagged = w.tags.size() != 0;
+			out.write(reinterpret_cast<const char*>(&slots), sizeof(uint64_t));
+			out.write(reinterpret_cast<const char*>(&tagged), sizeof(uint8_t));
+		}
+		out.write(reinterpret_cast<const char*>(value.data()), sizeof(type) * value.size());
+		out.write(reinterpret_cast<const char*>(w.tags.data()), sizeof(tag) * w.tags.size());
 		return out;
 	}
 	friend std::istream& operator >>(std::istream& in, weight& w) {
+		uint64_t size = 0, slots = 0;
+		uint8_t tagged = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+		if (size & hashed_flag) {
+			in.read(reinterpret_cast<char*>(&slots), sizeof(uint64_t));
+			in.read(reinterpret_cast<char*>(&tagged), sizeof(uint8_t));
+			w = weight(size & ~hashed_flag, slots, tagged);
+		} else {
+			w = weight(size);
+		}
 		auto& value = w.value;
+		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * value.size());
+		in.read(reinterpret_cast<char*>(w.tags.data()), sizeof(tag) * w.tags.size());
+		return in;
+	}
+
+	/**
+	 * the pages written since the last clean() are stored as
+	 * (slots:64-bit) (pages:64-bit) then for each page
+	 * (page:64-bit) (value:32-bit x page size) [(tag:16-bit x page size)]
+	 * where the last page may be shorter
+	 */
+	void save_delta(std::ostream& out) const {
+		uint64_t slots = value.size(), num = dirty_pages();
+		out.write(reinterpret_cast<const char*>(&slots), sizeof(uint64_t));
+		out.write(reinterpret_cast<const char*>(&num), sizeof(uint64_t));
+		for (uint64_t page = 0; (page << page_bits) < slots; page++) {
+			if (!(dirty[page >> 6] & (1ull << (page & 63)))) continue;
+			size_t head = page << page_bits, len = std::min(slots - head, size_t(1) << page_bits);
+			out.write(reinterpret_cast<const char*>(&page), sizeof(uint64_t));
+			out.write(reinterpret_cast<const char*>(value.data() + head), sizeof(type) * len);
+			if (tags.size()) out.write(reinterpret_cast<const char*>(tags.data() + head), sizeof(tag) * len);
+		}
+	}
+	/**
+	 * apply a delta written by save_delta(), the applied pages are marked as dirty
+	 * return false if the delta does not match the table
+	 */
+	bool load_delta(std::istream& in) {
+		uint64_t slots = 0, num = 0;
+		in.read(reinterpret_cast<char*>(&slots), sizeof(uint64_t));
+		in.read(reinterpret_cast<char*>(&num), sizeof(uint64_t));
+		if (!in || slots != value.size()) return false;
+		for (uint64_t i = 0, page; i < num; i++) {
+			in.read(reinterpret_cast<char*>(&page), sizeof(uint64_t));
+			size_t head = page << page_bits;
+			if (!in || head >= slots) return false;
+			size_t len = std::min(slots - head, size_t(1) << page_bits);
+			in.read(reinterpret_cast<char*>(value.data() + head), sizeof(type) * len);
+			if (tags.size()) in.read(reinterpret_cast<char*>(tags.data() + head), sizeof(tag) * len);
+			touch(head);
+		}
+		return bool(in);
+	}
+
+	/**
+	 * the coherence is not a part of the table format, and is stored separately for checkpoints
+	 * as (size:64-bit) (E:32-bit A:32-bit x size), where size is 0 if it is disabled
+	 */
+	void save_coherence(std::ostream& out) const {
+		uint64_t size = coherence.size() / 2;
+		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+		out.write(reinterpret_cast<const char*>(coherence.data()), sizeof(type) * coherence.size());
+	}
+	void load_coherence(std::istream& in) {
 		uint64_t size = 0;
 		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
-		value.resize(size);
-		in.read(reinterpret_cast<char*>(value.data()), sizeof(type) * size);
-		return in;
+		if (size != value.size()) {
+			in.ignore(sizeof(type) * 2 * size);
+			return;
+		}
+		coherence.assign(2 * size, 0);
+		in.read(reinterpret_cast<char*>(coherence.data()), sizeof(type) * coherence.size());
+	}
+
+	/**
+	 * the dirty pages are not a part of the table format either, and are stored for checkpoints
+	 * as (size:64-bit) (bitmap:64-bit x size), so that a delta after a resume has all the pages
+	 * written since the last clean(), the table is marked as all dirty if the bitmap does not match
+	 */
+	void save_dirty(std::ostream& out) const {
+		uint64_t size = dirty.size();
+		out.write(reinterpret_cast<const char*>(&size), sizeof(uint64_t));
+		out.write(reinterpret_cast<const char*>(dirty.data()), sizeof(uint64_t) * dirty.size());
+	}
+	void load_dirty(std::istream& in) {
+		uint64_t size = 0;
+		in.read(reinterpret_cast<char*>(&size), sizeof(uint64_t));
+		if (size != dirty.size()) {
+			in.ignore(sizeof(uint64_t) * size);
+			for (size_t head = 0; head < value.size(); head += size_t(1) << page_bits) touch(head);
+			return;
+		}
+		in.read(reinterpret_cast<char*>(dirty.data()), sizeof(uint64_t) * dirty.size());
 	}
 
 protected:
+	static constexpr uint64_t hashed_flag = 1ull << 63;
+
 	std::vector<type> value;
+	std::vector<tag> tags;
+	std::vector<type> coherence; // (E, A) per slot
+	std::vector<uint64_t> dirty;
+	size_t length;
+	unsigned bits;
+	size_t collisions;
 };